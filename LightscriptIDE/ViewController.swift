@@ -20,6 +20,14 @@ final class ViewController: NSViewController, NSWindowDelegate {
 
     // Time display
     private var timeDisplayField: NSTextField?
+
+    // While playing, Run applies the edited script to the running show
+    private var isPlaying = false
+
+    // Live edits are built off the main thread, one at a time.  The parser
+    // can't be shared, so Run and Check wait until the build is done.
+    private let applyQueue = DispatchQueue(label: "lightscript.applylive")
+    private var isApplying = false
     
     // Static reference for C callbacks
     private static weak var sharedInstance: ViewController?
@@ -207,6 +215,14 @@ final class ViewController: NSViewController, NSWindowDelegate {
             appendToStatus("No script to run\n")
             return
         }
+        if isApplying {
+            appendToStatus("Still applying the previous change\n")
+            return
+        }
+        if isPlaying {
+            applyLive(scriptText)
+            return
+        }
         statusTextView.string = ""
 
         setButtonsForIdleState()
@@ -271,8 +287,41 @@ final class ViewController: NSViewController, NSWindowDelegate {
         setButtonsForPlayingState()
         appendToStatus("Playback started\n")
     }
+
+    /// Re-parse the edited script and switch the running show over to it.
+    /// A big script takes a while to build, so that happens on applyQueue.
+    private func applyLive(_ scriptText: String) {
+        clearErrorHighlight()
+        isApplying = true
+        setPlayButtonEnabled(false)
+
+        let panelConfig = PreferencesViewController.panelConfigFile
+        let lightscriptConfig = PreferencesViewController.lightscriptConfigFile
+
+        applyQueue.async {
+            let result = lightscript_apply_live(panelConfig, lightscriptConfig, scriptText)
+            let errorLine = (result == -3) ? Int(lightscript_get_error_line()) : 0
+
+            DispatchQueue.main.async {
+                self.isApplying = false
+                self.setPlayButtonEnabled(true)
+                if result != 0 {
+                    if errorLine > 0 {
+                        self.highlightErrorLine(errorLine)
+                    }
+                    self.appendToStatus("Script not applied; still playing the previous version\n")
+                    return
+                }
+                self.appendToStatus("Applied changes to the running script\n")
+            }
+        }
+    }
     
     @IBAction func checkScript(_ sender: Any?) {
+        if isApplying {
+            appendToStatus("Still applying the previous change\n")
+            return
+        }
         statusTextView.string = ""
 
         guard let scriptText = textView.text, !scriptText.isEmpty else {
@@ -325,6 +374,7 @@ final class ViewController: NSViewController, NSWindowDelegate {
     
     @IBAction func stopScript(_ sender: Any?) {
         lightscript_playback_stop()
+        setButtonsForIdleState()
         //lightscript_disconnect()
         setTimeDisplay("00:00.00")
         appendToStatus("Playback interrupted\n")
@@ -542,8 +592,20 @@ final class ViewController: NSViewController, NSWindowDelegate {
         }
     }
     
+    /// Label the Play button for starting a show, or for applying edits to a running one
+    func setPlayButtonLabel(_ label: String) {
+        DispatchQueue.main.async {
+            if let toolbar = self.view.window?.toolbar,
+               let playItem = toolbar.items.first(where: { $0.itemIdentifier.rawValue == "RUN_SCRIPT" }) {
+                playItem.label = label
+            }
+        }
+    }
+    
     /// Set button states for idle mode (not playing)
     func setButtonsForIdleState() {
+        isPlaying = false
+        setPlayButtonLabel("Run")
         setPlayButtonEnabled(true)
         setCheckButtonEnabled(true) 
         setStopButtonEnabled(false)
@@ -551,7 +613,9 @@ final class ViewController: NSViewController, NSWindowDelegate {
     
     /// Set button states for playing mode
     func setButtonsForPlayingState() {
-        setPlayButtonEnabled(false)
+        isPlaying = true
+        setPlayButtonLabel("Apply Live")
+        setPlayButtonEnabled(true)
         setCheckButtonEnabled(false)
         setStopButtonEnabled(true)
     }
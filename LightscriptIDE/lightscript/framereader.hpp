@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <algorithm>
+#include "picoprotocol.h"
+
+//
+// Picks messages out of the byte stream from the other end: hunts for the
+// 0x02 0xAA sync, then takes the header and payload.  Bytes can come in
+// any size pieces; parse() remembers where it was.  A header claiming more
+// payload than a message can hold is thrown away and counted, and the
+// hunt for the next sync starts again.
+//
+#define LSFRAME_STATE_SYNC1     0
+#define LSFRAME_STATE_SYNC2     1
+#define LSFRAME_STATE_HDR       2
+#define LSFRAME_STATE_PAYLOAD   3
+
+class FrameParser {
+public:
+    void reset(void) {
+        state = LSFRAME_STATE_SYNC1;
+        have = 0;
+        badFrames = 0;
+    }
+
+    // Use up bytes until a message is complete or they run out.  Returns
+    // how many were used; 'complete' says whether message() is ready.
+    size_t parse(const uint8_t *buf, size_t len, bool& complete) {
+        const uint8_t *p = buf;
+        const uint8_t *end = buf + len;
+
+        complete = false;
+        while (p < end) {
+            switch (state) {
+                case LSFRAME_STATE_SYNC1:
+                    // Most of the time the sync is right here, but skip
+                    // junk quickly when it isn't.
+                    p = (const uint8_t *) memchr(p, 0x02, end - p);
+                    if (p == NULL) {
+                        return len;
+                    }
+                    p++;
+                    state = LSFRAME_STATE_SYNC2;
+                    break;
+                case LSFRAME_STATE_SYNC2:
+                    if (*p == 0xAA) {
+                        p++;
+                        have = 0;
+                        state = LSFRAME_STATE_HDR;
+                    } else {
+                        state = LSFRAME_STATE_SYNC1;
+                    }
+                    break;
+                case LSFRAME_STATE_HDR:
+                case LSFRAME_STATE_PAYLOAD: {
+                    size_t need = LSMSG_HDRSIZE + ((state == LSFRAME_STATE_PAYLOAD) ? msg.ls_length : 0);
+                    size_t n = std::min((size_t) (end - p), need - have);
+
+                    memcpy((uint8_t *) &msg + have, p, n);
+                    have += n;
+                    p += n;
+                    if (have < need) {
+                        break;
+                    }
+                    if (state == LSFRAME_STATE_HDR) {
+                        if (msg.ls_length > sizeof(msg.info)) {
+                            badFrames++;
+                            state = LSFRAME_STATE_SYNC1;
+                            break;
+                        }
+                        memset(&msg.info, 0, sizeof(msg.info));
+                        if (msg.ls_length != 0) {
+                            state = LSFRAME_STATE_PAYLOAD;
+                            break;
+                        }
+                    }
+                    state = LSFRAME_STATE_SYNC1;
+                    complete = true;
+                    return p - buf;
+                }
+            }
+        }
+        return len;
+    }
+
+    const lsmessage_t& message(void) { return msg; }
+
+    uint32_t badFrames = 0;             // Oversized headers skipped
+
+private:
+    int state = LSFRAME_STATE_SYNC1;
+    size_t have = 0;
+    lsmessage_t msg;
+};
+
+//
+// Reads messages from a board.  Each read takes whatever has arrived, up
+// to a buffer full, and the parser works through it, so a response costs
+// one or two system calls instead of one per byte.  Anything left over
+// stays for the next call.
+//
+#define LSREAD_BUFSIZE          4096
+#define LSREAD_TIMEOUT_MS       2000    // Default wait for a response
+
+#define LSREAD_OK               0
+#define LSREAD_TIMEOUT          -1      // Nothing complete in time
+#define LSREAD_CLOSED           -2      // The other end went away
+#define LSREAD_ERROR            -3      // read() or poll() failed, see errno
+
+class FrameReader {
+public:
+    // Start over on a new connection, or none (-1).
+    void reset(int newfd) {
+        fd = newfd;
+        head = tail = 0;
+        parser.reset();
+    }
+
+    int device(void) { return fd; }
+
+    // Wait up to 'timeoutMs' (-1 for ever) for the next message.
+    int next(lsmessage_t *msg, int timeoutMs) {
+        int64_t deadline = (timeoutMs < 0) ? -1 : millis() + timeoutMs;
+
+        for (;;) {
+            bool complete;
+            int res;
+
+            if (head < tail) {
+                head += parser.parse(&buf[head], tail - head, complete);
+                if (complete) {
+                    *msg = parser.message();
+                    return LSREAD_OK;
+                }
+                continue;
+            }
+
+            res = fill(deadline);
+            if (res != LSREAD_OK) {
+                return res;
+            }
+        }
+    }
+
+private:
+    // Wait for bytes and take as many as there are.
+    int fill(int64_t deadline) {
+        struct pollfd pfd;
+        ssize_t res;
+
+        if (fd < 0) {
+            return LSREAD_CLOSED;
+        }
+
+        head = tail = 0;
+        for (;;) {
+            int wait = (deadline < 0) ? -1 : (int) std::max<int64_t>(0, deadline - millis());
+
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            res = poll(&pfd, 1, wait);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return LSREAD_ERROR;
+            }
+            if (res == 0) {
+                return LSREAD_TIMEOUT;
+            }
+
+            res = read(fd, buf, sizeof(buf));
+            if (res > 0) {
+                tail = res;
+                return LSREAD_OK;
+            }
+            if (res == 0) {
+                return LSREAD_CLOSED;
+            }
+            if ((errno != EINTR) && (errno != EAGAIN)) {
+                return LSREAD_ERROR;
+            }
+        }
+    }
+
+    static int64_t millis(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    int fd = -1;
+    uint8_t buf[LSREAD_BUFSIZE];
+    size_t head = 0;
+    size_t tail = 0;
+    FrameParser parser;
+};
@@ -6,8 +6,12 @@
 #include "schedule.hpp"
 #include "lsinternal.h"
 #include "playback.h"
+#include "logring.hpp"
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 #include <cstring>
 
 extern "C" {
@@ -23,6 +27,13 @@ extern "C" {
 void (*g_playback_end_cb)(void) = nullptr;
 };
 
+// ---- A script edited while playing, waiting to be (or already) adopted ----
+struct LSLiveGen {
+    LSScript script;
+    LSSchedule sched;
+    playswap_t swap;
+};
+
 // ---- Single context (simple for now; you can make this per-session later) ----
 struct LSContext {
     LSTokenStream ts;
@@ -41,6 +52,19 @@ struct LSContext {
     int         last_error_line = 0;
     std::string last_error_msg = "";
 
+    // Last link load report, as JSON
+    std::string loadReport;
+
+    // Last send latency report, as JSON
+    std::string latencyReport;
+
+    // Live edits.  The playback thread owns whichever generation it
+    // adopted last; older ones are freed once it has moved past them.
+    std::vector<std::unique_ptr<LSLiveGen>> liveGens;
+    uint64_t    liveEpoch = 0;
+    LSScript   *runningScript = nullptr;
+    LSSchedule *runningSched = nullptr;
+
     LSContext() {
     }
 
@@ -48,43 +72,121 @@ struct LSContext {
         ts.reset();
         sched.reset();
         script.reset();
+        liveGens.clear();
+        runningScript = nullptr;
+        runningSched = nullptr;
         last_error_line = 0;
         last_error_msg.clear();
     }
 
+    void freeAdopted() {
+        uint64_t epoch = playback.play_epoch();
+        size_t i = 0;
+
+        // Keep the one in use and anything newer.
+        while ((i + 1 < liveGens.size()) && (liveGens[i+1]->swap.epoch <= epoch)) {
+            i++;
+        }
+        liveGens.erase(liveGens.begin(), liveGens.begin() + i);
+    }
+
     void report_error(const char* msg, int line = 0) {
         last_error_line = line;
         last_error_msg  = msg ? msg : "";
-        if (g_status_cb) g_status_cb(1, last_error_msg.c_str());
+        lsprinterr("%s", last_error_msg.c_str());
     }
 };
 
 static LSContext* g = nullptr;
 
 
+// ---- Status window logging ----
+// Any thread can log without waiting: lines go into a ring and a logging
+// thread hands them to the status callback, several lines per call.
+#define STATUSRING_SIZE     1024        // Power of two
+#define STATUSBATCH_MAX     64          // Lines per callback
+
+static LogRing<STATUSRING_SIZE> g_statusLog;
+static std::thread g_statusThread;
+static std::atomic<bool> g_statusStop{false};
+
+static void status_flush(std::string& batch)
+{
+    if (!batch.empty()) {
+        if (g_status_cb) g_status_cb(0, batch.c_str());
+        batch.clear();
+    }
+}
+
+static void status_run(void)
+{
+    std::string batch;
+    struct timespec ts = {0, 5000000};
+
+    for (;;) {
+        // Look before draining, so nothing logged before the stop is missed.
+        bool stopping = g_statusStop;
+        uint32_t dropped;
+        int n;
+
+        // Errors go on their own, the IDE highlights the error line for them.
+        n = g_statusLog.drain([&](const logrec_t& rec) {
+            if (rec.level == LSLOG_ERROR) {
+                status_flush(batch);
+                if (g_status_cb) g_status_cb(1, rec.text);
+            } else {
+                if (!batch.empty()) batch += '\n';
+                batch += rec.text;
+            }
+        }, STATUSBATCH_MAX);
+        status_flush(batch);
+
+        if ((dropped = g_statusLog.takeDropped()) != 0) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "(%u status lines dropped)", dropped);
+            if (g_status_cb) g_status_cb(0, msg);
+        }
+
+        if (n == 0) {
+            if (stopping) {
+                break;
+            }
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+static int status_log(int level, const char *str, va_list args)
+{
+    // Before init and after shutdown there's no logging thread, just call back.
+    if (!g_statusThread.joinable()) {
+        char textbuf[LSLOGREC_TEXT];
+        int ret = vsnprintf(textbuf, sizeof(textbuf), str, args);
+        if (g_status_cb) g_status_cb(level == LSLOG_ERROR, textbuf);
+        return ret;
+    }
+    return g_statusLog.push(level, str, args);
+}
+
 // If you have your own error facility inside LSParser/LSTokenStream,
 // consider wiring it so they call back into g->report_error(...).
 extern "C" {
 int lsprintf(const char * str, ...)
 {
-    static char textbuf[512];
     int ret;
     va_list args;
     va_start(args, str);
-    ret = vsnprintf(textbuf, sizeof(textbuf)-1, str, args);
+    ret = status_log(LSLOG_INFO, str, args);
     va_end(args);
-    if (g_status_cb) g_status_cb(0,textbuf);
     return ret;
 }
 int lsprinterr(const char * str, ...)
 {
-    static char textbuf[512];
     int ret;
     va_list args;
     va_start(args, str);
-    ret = vsnprintf(textbuf, sizeof(textbuf)-1, str, args);
+    ret = status_log(LSLOG_ERROR, str, args);
     va_end(args);
-    if (g_status_cb) g_status_cb(1,textbuf);
     return ret;
 }
 
@@ -94,6 +196,10 @@ extern "C" {
 
 int lightscript_init(void) {
     if (!g) g = new LSContext();
+    if (!g_statusThread.joinable()) {
+        g_statusStop = false;
+        g_statusThread = std::thread(status_run);
+    }
     // If Playback needs init, do it here
     return 0;
 }
@@ -128,7 +234,8 @@ int lightscript_set_device(const char* devname) {
 }
 
 int lightscript_get_error_line(void) {
-    return g ? g->ts.getErrorLine() : 0;
+    if (!g) return 0;
+    return g->last_error_line ? g->last_error_line : g->ts.getErrorLine();
 }
 
 int lightscript_reset(void) {
@@ -138,9 +245,8 @@ int lightscript_reset(void) {
     return 0;
 }
 
-int lightscript_tokenize_file(const char* filename)
+static int tokenize_file(LSTokenStream& ts, const char* filename)
 {
-    if (!g || !filename) return -1;
     lstoktype_t t;
     
     lsprintf("Loading file: %s", filename);
@@ -153,13 +259,63 @@ int lightscript_tokenize_file(const char* filename)
     // Call the lexer and read all the tokens into the token stream.
     while ((t = (lstoktype_t) yylex())) {
         LSToken tok = LSToken(t, filename, yylineno, &yylval);
-        g->ts.add(tok);
+        ts.add(tok);
     }
     
     fclose(yyin);
     return 0;
 }
 
+static int tokenize_string(LSTokenStream& ts, const char* scriptText)
+{
+    lstoktype_t t;
+
+    // Scan from memory buffer with Flex
+    YY_BUFFER_STATE buf = yy_scan_bytes(scriptText, (int)std::strlen(scriptText));
+    yylineno = 1;
+
+    while ((t = (lstoktype_t) yylex())) {
+        LSToken tok = LSToken(t, "script", yylineno, &yylval);
+        ts.add(tok);
+    }
+
+    yy_delete_buffer(buf);
+
+    return 0;
+}
+
+static bool sameBoard(const LSBoard& a, const LSBoard& b)
+{
+    if ((a.name != b.name) || (a.device != b.device)) return false;
+    if (a.virtualStripCount != b.virtualStripCount) return false;
+    for (int i = 0; i < MAXPSTRIPS; i++) {
+        if ((a.physicalStrips[i].name != b.physicalStrips[i].name) ||
+            (a.physicalStrips[i].info != b.physicalStrips[i].info)) return false;
+    }
+    for (int i = 0; i < a.virtualStripCount; i++) {
+        if ((a.virtualStrips[i].name != b.virtualStrips[i].name) ||
+            (a.virtualStrips[i].substripCount != b.virtualStrips[i].substripCount) ||
+            memcmp(a.virtualStrips[i].substrips, b.virtualStrips[i].substrips,
+                   sizeof(a.virtualStrips[i].substrips)) != 0) return false;
+    }
+    return true;
+}
+
+static bool sameStrips(const LSScript& a, const LSScript& b)
+{
+    if (a.boardCount != b.boardCount) return false;
+    for (int i = 0; i < a.boardCount; i++) {
+        if (!sameBoard(a.boards[i], b.boards[i])) return false;
+    }
+    return true;
+}
+
+int lightscript_tokenize_file(const char* filename)
+{
+    if (!g || !filename) return -1;
+    return tokenize_file(g->ts, filename);
+}
+
 int lightscript_parse_script(void)
 {
     lsprintf("Parsing script files");
@@ -177,6 +333,8 @@ int lightscript_parse_script(void)
         return -4;
     }
     lsprintf("Schedule generated.");
+    g->runningScript = &g->script;
+    g->runningSched = &g->sched;
     return 0;
 }
 
@@ -184,22 +342,81 @@ int lightscript_parse_script(void)
 int lightscript_tokenize_string(const char* scriptText)
 {
     if (!g || !scriptText) return -1;
-    lstoktype_t t;
+    return tokenize_string(g->ts, scriptText);
+}
 
-    // Scan from memory buffer with Flex
-    YY_BUFFER_STATE buf = yy_scan_bytes(scriptText, (int)std::strlen(scriptText));
-    yylineno = 1;
+int lightscript_apply_live(const char *panelcfg, const char *lscfg, const char *scriptText)
+{
+    if (!g || !panelcfg || !lscfg || !scriptText) return -1;
+    if (!g->playback.play_running() || !g->runningSched) {
+        lsprinterr("Nothing is playing");
+        return -5;
+    }
 
-    while ((t = (lstoktype_t) yylex())) {
-        LSToken tok = LSToken(t, "script", yylineno, &yylval);
-        g->ts.add(tok);
+    g->freeAdopted();
+    g->last_error_line = 0;
+
+    LSTokenStream ts;
+    LSParser parser;
+    std::unique_ptr<LSLiveGen> gen = std::make_unique<LSLiveGen>();
+
+    if (tokenize_file(ts, panelcfg) != 0) return -2;
+    if (tokenize_file(ts, lscfg) != 0) return -2;
+    if (tokenize_string(ts, scriptText) != 0) return -2;
+
+    parser.init(&ts, &gen->script);
+    try {
+        parser.parseTopLevel();
+    } catch (...) {
+        g->last_error_line = ts.getErrorLine();
+        return -3;
+    }
+    if (gen->sched.generate(gen->script) == false) {
+        g->report_error("Could not generate schedule",0);
+        return -4;
     }
 
-    yy_delete_buffer(buf);
+    if (!sameStrips(*g->runningScript, gen->script)) {
+        lsprinterr("Strip configuration changed; stop and run the script again");
+        return -6;
+    }
+    if (gen->script.lss_music != g->runningScript->lss_music) {
+        lsprintf("Music file changed; it will not be switched until the next run");
+    }
+
+    int added, removed, unchanged;
+    if (g->runningSched->diff(gen->sched, added, removed, unchanged)) {
+        lsprintf("Schedule changes: %d added, %d removed, %d unchanged", added, removed, unchanged);
+    }
+
+    // Have the log lines and frames ready, the playback thread won't stop to make them.
+    gen->sched.formatLog();
+    gen->sched.compileFrames();
+
+    gen->swap.script = &gen->script;
+    gen->swap.sched = &gen->sched;
+    gen->swap.epoch = ++g->liveEpoch;
+
+    g->runningScript = &gen->script;
+    g->runningSched = &gen->sched;
+    g->playback.play_swap(&gen->swap);
+    g->liveGens.push_back(std::move(gen));
 
     return 0;
 }
 
+const char *lightscript_analyze_load(double bytes_per_sec)
+{
+    if (!g || !g->runningSched) return NULL;
+    if (bytes_per_sec <= 0) bytes_per_sec = LSLOAD_DEFAULT_RATE;
+
+    schedload_t report;
+    g->runningSched->analyzeLoad(bytes_per_sec, report);
+    g->runningSched->printLoad(report);
+    g->loadReport = g->runningSched->loadJson(report);
+    return g->loadReport.c_str();
+}
+
 int lightscript_connect(void) {
     if (!g) return -1;
     if (g->playback.play_opendevice((char *) g->deviceName.c_str()) < 0) {
@@ -238,6 +455,15 @@ void lightscript_playback_wait(void)
     g->playback.play_wait();
 }
 
+const char *lightscript_latency_report(void)
+{
+    if (!g || g->playback.play_running()) return NULL;
+
+    g->playback.print_latency();
+    g->latencyReport = g->playback.latency_json();
+    return g->latencyReport.c_str();
+}
+
 void lightscript_playback_stop(void) {
     if (!g) return;
     g->playback.play_interrupt();
@@ -247,6 +473,16 @@ void lightscript_playback_stop(void) {
 
 void lightscript_shutdown(void) {
     if (!g) return;
+
+    // Nothing should be logging while the state is torn down: stop the
+    // show, then let the last lines out before the logging thread goes.
+    g->playback.play_interrupt();
+    g->playback.play_wait();
+    g_statusStop = true;
+    if (g_statusThread.joinable()) {
+        g_statusThread.join();
+    }
+
     // RAII cleans up everything
     delete g;
     g = nullptr;
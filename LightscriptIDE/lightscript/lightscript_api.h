@@ -47,6 +47,28 @@ void lightscript_set_script_directory(const char *dirname);
 //
 int lightscript_parse_script(void);
 
+//
+// Re-parse the script while it is playing and switch playback over to the new
+// schedule from the current time onward.  The config files are read again, but the
+// strip layout must not change.  This may be called from any thread, but not at the
+// same time as another call that tokenizes or parses.  Returns:
+//     0  the new schedule is playing
+//    -1  not initialized, or a NULL argument
+//    -2  a file or the script text could not be read
+//    -3  parse error, see lightscript_get_error_line()
+//    -4  the schedule could not be generated
+//    -5  nothing is playing
+//    -6  the strip layout changed; stop and run the script again
+//
+int lightscript_apply_live(const char *panelcfg, const char *lscfg, const char *script);
+
+//
+// Work out whether the link to the board can keep up with the parsed script.  A summary
+// goes to the status window, and the full report is returned as JSON.  The string is valid
+// until the next call.  Pass 0 for the default link speed.
+//
+const char *lightscript_analyze_load(double bytes_per_sec);
+
 //
 // Connect, disconnect from PicoLaser board
 // In general we will connect just before script playback - after parsing, we will connect and
@@ -63,6 +85,13 @@ int lightscript_playback_start(int with_music);
 void lightscript_playback_stop(void);
 void lightscript_playback_wait(void);
 
+//
+// How late events went out to the board on the last playback: percentiles, a histogram
+// and the latest source lines.  A summary goes to the status window, and the full report
+// is returned as JSON.  The string is valid until the next call.  NULL while playing.
+//
+const char *lightscript_latency_report(void);
+
 //
 // Applicaton termination
 //
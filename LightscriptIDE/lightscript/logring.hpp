@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <atomic>
+
+//
+// A bounded queue of log lines.  Any number of threads can add lines
+// without taking a lock or waiting; one thread takes them out.  When it
+// is full new lines are dropped and counted, so whoever is logging never
+// waits for whoever is printing.
+//
+// Each slot carries a sequence number saying whose turn it is: a producer
+// may fill slot i when its sequence is i, the consumer may read it once it
+// is i+1, and hands it back for the next lap as i+SLOTS.
+//
+#define LSLOGREC_TEXT   512
+
+#define LSLOG_INFO      0
+#define LSLOG_ERROR     1
+
+typedef struct logrec_s {
+    int level;                          // LSLOG_INFO or LSLOG_ERROR
+    double time;                        // Monotonic seconds when it was logged
+    char text[LSLOGREC_TEXT];
+} logrec_t;
+
+template <int SLOTS>
+class LogRing {
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "LogRing size must be a power of two");
+
+public:
+    LogRing() {
+        reset();
+    }
+
+    // Only when nobody is using it.
+    void reset(void) {
+        for (uint32_t i = 0; i < SLOTS; i++) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        head.store(0, std::memory_order_relaxed);
+        tail = 0;
+        drops.store(0, std::memory_order_relaxed);
+    }
+
+    // Claim a slot and let fill(char *buf, size_t len) write the text.
+    // Returns false, and counts a drop, if the ring is full.
+    template <typename F>
+    bool emplace(int level, F fill) {
+        uint32_t pos = head.load(std::memory_order_relaxed);
+        slot_t *s;
+
+        for (;;) {
+            s = &slots[pos & (SLOTS - 1)];
+            int32_t dif = (int32_t) (s->seq.load(std::memory_order_acquire) - pos);
+            if (dif == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                drops.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+
+        s->rec.level = level;
+        s->rec.time = monotonic();
+        fill(s->rec.text, sizeof(s->rec.text));
+        s->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // printf into a slot.  Returns the length, or -1 if it was dropped.
+    int push(int level, const char *fmt, va_list args) {
+        int ret = -1;
+
+        emplace(level, [&](char *buf, size_t len) {
+            ret = vsnprintf(buf, len, fmt, args);
+        });
+        return ret;
+    }
+
+    // Consumer only.  Call f(const logrec_t&) on up to 'max' lines, oldest
+    // first, and return how many there were.
+    template <typename F>
+    int drain(F f, int max) {
+        int n = 0;
+
+        while (n < max) {
+            slot_t *s = &slots[tail & (SLOTS - 1)];
+            if (s->seq.load(std::memory_order_acquire) != tail + 1) {
+                break;
+            }
+            f(s->rec);
+            s->seq.store(tail + SLOTS, std::memory_order_release);
+            tail++;
+            n++;
+        }
+        return n;
+    }
+
+    // Lines dropped since the last call.
+    uint32_t takeDropped(void) {
+        return drops.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    static double monotonic(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0;
+    }
+
+    typedef struct slot_s {
+        std::atomic<uint32_t> seq;
+        logrec_t rec;
+    } slot_t;
+
+    slot_t slots[SLOTS];
+    alignas(64) std::atomic<uint32_t> head;     // Next slot for a producer
+    alignas(64) uint32_t tail;                  // Next slot for the consumer
+    std::atomic<uint32_t> drops;
+};
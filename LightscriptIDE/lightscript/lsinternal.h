@@ -20,6 +20,9 @@
 //#define MAXVSTRIPS      128             // Total virtual strips 
 //#define MAXSUBSTRIPS    8               // Substrips per virtual strip
 
+#define LSMAXBOARDS     8                                   // Boards one script can drive
+#define LSMAXSTRIPS     (MAXVSTRIPS * LSMAXBOARDS)          // Virtual strips across all boards
+
 typedef enum {
     LSC_UNKNOWN = 0,
     LSC_CASCADE = 1,
@@ -96,6 +99,52 @@ typedef struct VStrip_s {
     uint32_t substrips[MAXSUBSTRIPS+1];         // Leave one for the sentinel
 } VStrip_t;
 
+//
+// One Picolight/PicoLaser board and its strips.  Virtual strips are numbered
+// from zero on each board; across the whole script, strip 'v' on board 'b'
+// is b*MAXVSTRIPS + v.
+//
+class LSBoard {
+public:
+    std::string name;                   // Empty for the first board, unless named
+    std::string device;                 // Address; the first board uses the one chosen at playback
+
+    // No need for symbol tables for these because they are fixed in size by the firmware.
+    // Physical Strips.
+    PStrip_t physicalStrips[MAXPSTRIPS] = {};
+    // Virtual Strips
+    int virtualStripCount = 0;
+    VStrip_t virtualStrips[MAXVSTRIPS] = {};
+
+    LSBoard() {
+        reset();
+    }
+
+    bool isEmpty() const {
+        if (virtualStripCount != 0) return false;
+        for (auto i = 0; i < MAXPSTRIPS; i++) {
+            if (!physicalStrips[i].name.empty()) return false;
+        }
+        return true;
+    }
+
+    void reset() {
+        name.clear();
+        device.clear();
+        for (auto i = 0; i < MAXPSTRIPS; i++) {
+            physicalStrips[i].name.clear();
+            physicalStrips[i].idx = i;
+            physicalStrips[i].info = 0;
+        }
+        for (auto i = 0; i < MAXVSTRIPS; i++) {
+            virtualStrips[i].name.clear();
+            virtualStrips[i].idx = i;
+            virtualStrips[i].substripCount = 0;
+            memset(virtualStrips[i].substrips,0,sizeof(virtualStrips[i].substrips));
+        }
+        virtualStripCount = 0;
+    }
+};
 
 class LSScript {
 public:
@@ -118,12 +167,18 @@ public:
     LSStripListTab stripListTable;
     LSMacroTab macroTable;
 
-    // No need for symbol tables for these because they are fixed in size by the firmware.
-    // Physical Strips.
-    PStrip_t physicalStrips[MAXPSTRIPS] = {};
-    // Virtual Strips
-    int virtualStripCount = 0;
-    VStrip_t virtualStrips[MAXVSTRIPS] = {};
+    // Boards, the first one is always there.
+    int boardCount = 1;
+    LSBoard boards[LSMAXBOARDS];
+
+    // Board by name, or the first board for an empty name.  NULL if not found.
+    LSBoard *findBoard(const std::string& name) {
+        if (name.empty()) return &boards[0];
+        for (auto i = 0; i < boardCount; i++) {
+            if (boards[i].name == name) return &boards[i];
+        }
+        return nullptr;
+    }
 
     void reset() {
         symbolTable.reset();
@@ -131,20 +186,12 @@ public:
         colorTable.reset();
         stripListTable.reset();
         macroTable.reset();
-        for (auto i = 0; i < MAXPSTRIPS; i++) {
-            physicalStrips[i].name.clear();
-            physicalStrips[i].idx = 0;
-            physicalStrips[i].info = 0;
-        }
-        for (auto i = 0; i < MAXVSTRIPS; i++) {
-            virtualStrips[i].name.clear();
-            virtualStrips[i].idx = 0;
-            virtualStrips[i].substripCount = 0;
-            memset(virtualStrips[i].substrips,0,sizeof(virtualStrips[i].substrips));
+        for (auto i = 0; i < LSMAXBOARDS; i++) {
+            boards[i].reset();
         }
+        boardCount = 1;
         lss_startcue = 0;
         lss_endcue = 0;
-        virtualStripCount = 0;
         if (lss_idlestrips.get() != nullptr) lss_idlestrips.get()->clear();
         lss_music.clear();
         lss_idleanimation.clear();
@@ -43,6 +43,16 @@ extern "C" {
 
 char *inpfilename = (char *) "input";
 int debug = 0;
+int lazy = 0;
+int optimize = 0;
+int analyze = 0;
+int quiet = 0;
+double spinwindow = PLAYSPIN_DEFAULT;
+double sendahead = PLAYAHEAD_DEFAULT;
+double linkrate = LSLOAD_DEFAULT_RATE;
+char *jsonfilename = NULL;
+char *framefilename = NULL;
+char *latencyfilename = NULL;
 
 LSTokenStream tokenStream;
 static LSScript *script = NULL;
@@ -156,7 +166,7 @@ static bool tokenize_file(char *filename)
     return true;
 }
 
-static void script_showpstrips(LSScript *script)
+static void script_showpstrips(LSBoard *board)
 {
     int idx;
     char chName;
@@ -164,7 +174,7 @@ static void script_showpstrips(LSScript *script)
     
     printf("Physical strip table:\n");
     for (idx = 0; idx < MAXPSTRIPS; idx++) {
-        PStrip_t *strip = &script->physicalStrips[idx];
+        PStrip_t *strip = &board->physicalStrips[idx];
         if (strip->name == "") continue;
 
         if (PSTRIP_TYPE(strip->info) == PSTRIP_TYPE_LASER) {
@@ -183,16 +193,16 @@ static void script_showpstrips(LSScript *script)
 }
 
 static const char *stripChars = "1234567890ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-static void script_showvstrips(LSScript *script)
+static void script_showvstrips(LSBoard *board)
 {
     int idx;
     int ss;        
     VStrip_t *vstrip;
 
-    printf("\nVirtual strip table (%u entries):\n",script->virtualStripCount);
+    printf("\nVirtual strip table (%u entries):\n",board->virtualStripCount);
 
-    for (idx = 0; idx < script->virtualStripCount; idx++) {
-        vstrip = &script->virtualStrips[idx];
+    for (idx = 0; idx < board->virtualStripCount; idx++) {
+        vstrip = &board->virtualStrips[idx];
         printf("  %-20.20s '%c'  ",vstrip->name.c_str(), stripChars[idx]);
         for (ss = 0; ss < vstrip->substripCount; ss++) {
             uint32_t chan = SUBSTRIP_CHAN(vstrip->substrips[ss]);
@@ -224,8 +234,17 @@ static void script_stats(LSScript *script)
     printf("Macro list size:     %d\n",script->macroTable.size());
     printf("\n");
 
-    script_showpstrips(script);
-    script_showvstrips(script);
+    for (int b = 0; b < script->boardCount; b++) {
+        LSBoard *board = &script->boards[b];
+
+        if (script->boardCount > 1) {
+            printf("%sBoard %s at %s:\n", b ? "\n" : "",
+                   board->name.empty() ? "default" : board->name.c_str(),
+                   board->device.empty() ? "the playback device" : board->device.c_str());
+        }
+        script_showpstrips(board);
+        script_showvstrips(board);
+    }
 
     printf("\n\n\n");
 }
@@ -244,15 +263,6 @@ static LSScript *do_parse(void)
     // script->stripListTable = new LSStripListTab;
 //    script->macroTable = new LSMacroTab;
 
-    // Initialize the index values from the pstrip and vstrip tables,
-    // not sure if we really need it.
-    for (unsigned int idx = 0; idx < MAXPSTRIPS; idx++) {
-            script->physicalStrips[idx].idx = idx;
-        }
-    for (unsigned int idx = 0; idx < MAXVSTRIPS; idx++) {
-            script->virtualStrips[idx].idx = idx;
-        }
-
     // Go parse the file.
     if (parser->parse() == 0) {
         printf("File parsed successfully\n");
@@ -263,7 +273,7 @@ static LSScript *do_parse(void)
     return NULL;
 }
 
-static bool read_and_parse(char *panelconfigfilename, char *configfilename, char *scriptfilename)
+static bool read_and_parse(char *panelconfigfilename, char *configfilename, char *scriptfilename, bool checking)
 {
     if (panelconfigfilename) {
         if (!tokenize_file(panelconfigfilename)) {
@@ -293,11 +303,26 @@ static bool read_and_parse(char *panelconfigfilename, char *configfilename, char
 
     // Generate our schedule if we get this far.
     schedule = new LSSchedule();
-    if (schedule->generate(*script) == false) {
+    if ((lazy ? schedule->generateStream(*script) : schedule->generate(*script)) == false) {
         printf("Errors found while generating the schedule\n");
         return false;
     }
 
+    if (optimize) {
+        if (lazy) {
+            printf("Schedule optimization is not available with -l\n");
+        } else {
+            int dropped = schedule->dropDead(debug != 0, true);
+            printf("Dead-event elimination dropped %d events\n", dropped);
+            int saved = schedule->coalesce();
+            printf("Coalescing saved %d wire messages\n", saved);
+        }
+    } else if (checking && debug && !lazy) {
+        // Say what -O would drop, but play the schedule as written.
+        int dead = schedule->dropDead(true, false);
+        printf("Dead-event elimination would drop %d events (use -O)\n", dead);
+    }
+
     return true;
 }
 
@@ -340,12 +365,22 @@ static int parse_range(char *str, double *start, double *end)
 
 static void usage(void)
 {
-    fprintf(stderr,"Usage: lightscript [-p panelconfig] [-c configfile] [-v] [-d device] command script-file\n\n");
+    fprintf(stderr,"Usage: lightscript [-p panelconfig] [-c configfile] [-v] [-l] [-O] [-a] [-b rate] [-j file] [-q] [-w usec] [-A msec] [-f file] [-L file] [-d device] command script-file\n\n");
     fprintf(stderr,"    -p configfile       Specifies the name of a panel configuration file, default 'panel.cfg'\n");
     fprintf(stderr,"    -c configfile       Specifies the name of a configuration file, default 'lightscript.cfg'\n");
     fprintf(stderr,"    -d device           Specifies the name of the PicoLight device\n");
     fprintf(stderr,"    -s time             Starting time for playback\n");
-    fprintf(stderr,"    -v                  Print diagnostic output\n");
+    fprintf(stderr,"    -l                  Generate events lazily during playback (for very large scripts)\n");
+    fprintf(stderr,"    -O                  Optimize the schedule to reduce traffic to the PicoLight\n");
+    fprintf(stderr,"    -a                  Report the load the schedule puts on the link to the PicoLight\n");
+    fprintf(stderr,"    -b rate             Link speed in bytes/sec for -a, default %d\n", LSLOAD_DEFAULT_RATE);
+    fprintf(stderr,"    -j file             Also write the -a report to a file as JSON\n");
+    fprintf(stderr,"    -q                  Don't print each event as it is played\n");
+    fprintf(stderr,"    -A msec             Send events this far ahead to boards that can queue them, 0 for off, default %d\n", (int) (PLAYAHEAD_DEFAULT * 1000));
+    fprintf(stderr,"    -f file             Write the schedule to a file exactly as it would be sent to the PicoLight\n");
+    fprintf(stderr,"    -L file             After playing, write how late each event was sent to a file as JSON\n");
+    fprintf(stderr,"    -w usec             Busy-wait this long before each event instead of sleeping, default %d\n", (int) (PLAYSPIN_DEFAULT * 1000000));
+    fprintf(stderr,"    -v                  Print diagnostic output; with check, list the events -O would drop\n");
     fprintf(stderr,"\n");
     fprintf(stderr,"  Commands:\n");
     fprintf(stderr,"\n");
@@ -399,7 +434,7 @@ int main(int argc,char *argv[])
 
     printf("Lightscript version %s\n\n",VERSION);
     
-    while ((ch = getopt(argc,argv,"c:p:vd:s:")) != -1) {
+    while ((ch = getopt(argc,argv,"c:p:vd:s:lOab:j:qw:f:A:L:")) != -1) {
         switch (ch) {
             case 'c':
                 configfilename = optarg;
@@ -416,6 +451,37 @@ int main(int argc,char *argv[])
             case 's':
                 parse_range(optarg,&start_cue,&end_cue);
                 break;
+            case 'l':
+                lazy = 1;
+                break;
+            case 'O':
+                optimize = 1;
+                break;
+            case 'a':
+                analyze = 1;
+                break;
+            case 'b':
+                linkrate = atof(optarg);
+                break;
+            case 'j':
+                analyze = 1;
+                jsonfilename = optarg;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'w':
+                spinwindow = atof(optarg) / 1000000.0;
+                break;
+            case 'f':
+                framefilename = optarg;
+                break;
+            case 'A':
+                sendahead = atof(optarg) / 1000.0;
+                break;
+            case 'L':
+                latencyfilename = optarg;
+                break;
         }
     }
 
@@ -521,7 +587,7 @@ int main(int argc,char *argv[])
     }
 
     // Read and parse the file, bail if we can't do it.
-    if (read_and_parse(panelconfigfilename, configfilename, scriptfilename) == false) {
+    if (read_and_parse(panelconfigfilename, configfilename, scriptfilename, cmdnum == CMD_CHECK) == false) {
         exit(1);
     }
 
@@ -541,8 +607,42 @@ int main(int argc,char *argv[])
         }
     }
 
-    // Print the schedule if we get this far.
-    schedule->printSched();
+    // Print the schedule if we get this far.  A lazy schedule is only
+    // expanded for 'check', otherwise it would defeat the purpose.
+    if (!lazy || (cmdnum == CMD_CHECK)) {
+        schedule->printSched();
+    }
+
+    if (analyze) {
+        schedload_t report;
+
+        if (linkrate <= 0) {
+            fprintf(stderr,"Link speed must be more than zero\n");
+            exit(1);
+        }
+        printf("\n");
+        schedule->analyzeLoad(linkrate, report);
+        schedule->printLoad(report);
+        if (jsonfilename) {
+            FILE *f = fopen(jsonfilename,"w");
+            if (!f) {
+                fprintf(stderr,"Could not open %s : %s\n",jsonfilename,strerror(errno));
+                exit(1);
+            }
+            fputs(schedule->loadJson(report).c_str(), f);
+            fclose(f);
+        }
+    }
+
+    if (framefilename) {
+        if (lazy) {
+            fprintf(stderr,"Can't write the frames for a lazy schedule\n");
+            exit(1);
+        }
+        if (!schedule->dumpFrames(framefilename)) {
+            exit(1);
+        }
+    }
 
     struct sigaction sigint_action;
     memset(&sigint_action,0,sizeof(sigint_action));
@@ -553,6 +653,9 @@ int main(int argc,char *argv[])
 
     if ((cmdnum == CMD_MPLAY) || (cmdnum == CMD_PLAY)) {
         playback.play_opendevice(picolight);
+        playback.set_logging(!quiet);
+        playback.set_spin_window(spinwindow);
+        playback.set_send_ahead(sendahead);
         playback.play_init(script, schedule);
         playback.play_initdevice();
         printf("\n\n");
@@ -571,6 +674,18 @@ int main(int argc,char *argv[])
 
         playback.play_wait();
         playback.play_closedevice();
+
+        printf("\n");
+        playback.print_latency();
+        if (latencyfilename) {
+            FILE *f = fopen(latencyfilename,"w");
+            if (!f) {
+                fprintf(stderr,"Could not open %s : %s\n",latencyfilename,strerror(errno));
+                exit(1);
+            }
+            fputs(playback.latency_json().c_str(), f);
+            fclose(f);
+        }
     
     }
 
@@ -501,8 +501,8 @@ void LSParser::parseOnePhysicalStrip(void)
     unsigned int encodedStrip = ENCODEPSTRIP(physChannel, physChanType, physCount);
 
     // Add this to the physical strip table.
-    script->physicalStrips[physChannel].info = encodedStrip;
-    script->physicalStrips[physChannel].name = physStripName;
+    board->physicalStrips[physChannel].info = encodedStrip;
+    board->physicalStrips[physChannel].name = physStripName;
 }
 
 PStrip_t * LSParser::findPStrip(std::string& name)
@@ -510,8 +510,8 @@ PStrip_t * LSParser::findPStrip(std::string& name)
     int idx;
 
     for (idx = 0; idx < MAXPSTRIPS; idx++) {
-        if (script->physicalStrips[idx].name == name) {
-            return &(script->physicalStrips[idx]);
+        if (board->physicalStrips[idx].name == name) {
+            return &(board->physicalStrips[idx]);
         }
     }
     return NULL;
@@ -588,17 +588,27 @@ void LSParser::parseOneVirtualStrip(void)
     uint32_t encodedSubstrip;
     VStrip_t *vstrip;
 
-    if (script->virtualStripCount >= MAXVSTRIPS) {
+    if (board->virtualStripCount >= MAXVSTRIPS) {
         tokenStream->error("Maximium number of virtual strips have been defined (%u)", MAXVSTRIPS);
     }
 
-    vstrip = &(script->virtualStrips[script->virtualStripCount]);
-    script->virtualStripCount++;
+    vstrip = &(board->virtualStrips[board->virtualStripCount]);
+    board->virtualStripCount++;
     
     tokenStream->match(tVSTRIP);
 
     vstrip->name = tokenStream->matchIdent();
 
+    // Strip names are shared by all the boards.
+    for (int b = 0; b < script->boardCount; b++) {
+        LSBoard *other = &script->boards[b];
+        for (int i = 0; i < other->virtualStripCount; i++) {
+            if ((&other->virtualStrips[i] != vstrip) && (other->virtualStrips[i].name == vstrip->name)) {
+                tokenStream->error("Virtual strip %s is already defined", vstrip->name.c_str());
+            }
+        }
+    }
+
     tokenStream->match(CHARTOKEN('{'));
 
     // Grab all the sub strips
@@ -616,8 +626,51 @@ void LSParser::parseOneVirtualStrip(void)
 
 }
 
+//
+// 'physical' and 'virtual' can be followed by a board name, so one script
+// can drive several boards.  Without a name they refer to the first board.
+// The first board to be named takes over the first board if it has no
+// strips yet.  Other boards give their address after the name in 'physical':
+//
+//     physical stage "192.168.1.21" { ... };
+//     virtual stage { ... };
+//
+LSBoard *LSParser::parseBoard(bool withDevice)
+{
+    std::string name;
+    LSBoard *b;
+
+    if (tokenStream->current() == tIDENT) {
+        name = tokenStream->matchIdent();
+    }
+
+    b = script->findBoard(name);
+    if (b == NULL) {
+        if (script->boards[0].name.empty() && script->boards[0].isEmpty()) {
+            b = &script->boards[0];
+        } else {
+            if (script->boardCount >= LSMAXBOARDS) {
+                tokenStream->error("Maximum number of boards have been defined (%u)", LSMAXBOARDS);
+            }
+            b = &script->boards[script->boardCount++];
+        }
+        b->name = name;
+    }
+
+    if (withDevice && (tokenStream->current() == tSTRING)) {
+        if (b == &script->boards[0]) {
+            tokenStream->error("Board %s is the first board, it uses the device chosen for playback", name.c_str());
+        }
+        b->device = tokenStream->matchString();
+    }
+
+    return b;
+}
+
 void LSParser::parsePhysicalStrips(void)
 {
+    board = parseBoard(true);
+
     tokenStream->match(CHARTOKEN('{'));
 
     while (tokenStream->current() != CHARTOKEN('}')) {
@@ -629,6 +682,8 @@ void LSParser::parsePhysicalStrips(void)
 
 void LSParser::parseVirtualStrips(void)
 {
+    board = parseBoard(false);
+
     tokenStream->match(CHARTOKEN('{'));
 
     while (tokenStream->current() != CHARTOKEN('}')) {
@@ -13,6 +13,7 @@ public:
 private:
     LSTokenStream *tokenStream;
     LSScript *script;
+    LSBoard *board = nullptr;           // Board whose strips we are reading
 
 public:
     int parse();
@@ -29,6 +30,7 @@ private:
     void parseOption(LSCommand_t& cmd);
     void parseOptionList(LSCommand_t& cmd);
     void parseMacroBody(idlist_t * &idl, cmdlist_t * &cmdl);
+    LSBoard *parseBoard(bool withDevice);
     void parsePhysicalStrips(void);
     void parseVirtualStrips(void);
     void parseOnePhysicalStrip(void);
@@ -0,0 +1,793 @@
+/*  *********************************************************************
+    *  LightScript - A script processor for LED animations
+    *
+    *  Picolight Emulator                       File: picoemu.cpp
+    *
+    *  Pretends to be a Picolight board, over TCP like the network
+    *  boards and over a pseudo-terminal like the USB ones, so playback
+    *  can be tested and timed without hardware.
+    *
+    *  Author:  Mitch Lichtenberg
+    ********************************************************************* */
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "picoprotocol.h"
+#include "framereader.hpp"
+
+#define VERSION "1.0"
+
+#define EMU_PORT            4242        // Where playback looks for network boards
+#define EMU_QUEUE_DEFAULT   64          // LSCMD_ANIMATE_AT commands the board can hold
+#define EMU_CHUNK           4096        // Largest read from the host
+#define EMU_SPIN_USEC       200         // Busy-wait this long before running a queued command
+
+#define EMU_FW_MAJOR        1
+#define EMU_FW_MINOR        0
+
+//
+// Command line settings.
+//
+typedef struct emuopts_s {
+    const char *tcpAddr;                // NULL for no TCP
+    bool pty;
+    int protocol;
+    int queueSize;
+    double linkRate;                    // Bytes per second, 0 for as fast as it comes
+    int64_t latency;                    // Microseconds added to everything the host sends
+} emuopts_t;
+
+static emuopts_t opts = {
+    "127.0.0.1", false, PICOLIGHT_PROTOCOL_VERSION, EMU_QUEUE_DEFAULT, 0, 0
+};
+
+//
+// The board's configuration and EEPROM.  There's one board, however many
+// ways there are to reach it.
+//
+static std::mutex boardLock;
+static uint32_t pstrips[MAXPSTRIPS];
+static lsvstrip_t vstrips[MAXVSTRIPS];
+static int vstripCount = 0;
+static bool initialized = false;
+static uint32_t configHash = 0;
+static std::map<std::string, std::string> eeprom;
+
+//
+// Everything the board hears goes to the log, one line per message, with
+// the time in microseconds since the emulator started.
+//
+static std::mutex logLock;
+static FILE *logfile = NULL;
+
+static std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static int64_t micros(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+static std::chrono::steady_clock::time_point when_steady(int64_t us)
+{
+    return startTime + std::chrono::microseconds(us);
+}
+
+static void emulog(int64_t t, const char *fmt, ...)
+{
+    va_list args;
+
+    if (logfile == NULL) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(logLock);
+    fprintf(logfile, "%lld.%06lld ", (long long) (t / 1000000), (long long) (t % 1000000));
+    va_start(args, fmt);
+    vfprintf(logfile, fmt, args);
+    va_end(args);
+    fputc('\n', logfile);
+}
+
+static void log_animate(int64_t t, const char *what, const lsanimate_t *la, const char *extra)
+{
+    emulog(t, "%s anim %u speed %u option %u color %08X strips %08X%08X%08X%08X%s",
+           what, la->la_anim, la->la_speed, la->la_option, la->la_color,
+           la->la_strips[3], la->la_strips[2], la->la_strips[1], la->la_strips[0], extra);
+}
+
+//
+// Bytes from the host, and when the board gets to see them once they have
+// been through the pretend link.
+//
+typedef struct emuchunk_s {
+    int64_t deliver;
+    std::vector<uint8_t> data;
+} emuchunk_t;
+
+// A command waiting for its time.  'seq' keeps ones due together in order.
+typedef struct emuqueued_s {
+    uint32_t when;
+    uint64_t seq;
+    lsanimate_t anim;
+} emuqueued_t;
+
+typedef struct emustats_s {
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t animates;
+    uint64_t queued;
+    uint64_t ran;                       // Queued commands that ran
+    uint64_t flushed;
+    int64_t worstLate;                  // Microseconds a queued command ran after its time
+    uint64_t errors;
+} emustats_t;
+
+//
+// One host talking to the board.  A reader thread takes bytes off the
+// connection as they come and stamps them; the session thread hands them
+// to the board when the link would have, answers, and runs queued commands
+// when they are due.
+//
+class EmuSession {
+public:
+    EmuSession(int fd, std::string name) : fd(fd), name(name) {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    void run(void);
+    void report(void);
+
+private:
+    void reader(void);
+    void receive(const uint8_t *buf, size_t len, int64_t now);
+    void handle(int64_t now);
+    void respond(const void *payload, int len);
+    void eeprom_command(const lseeprom_t *req, lseeprom_t *resp);
+    int64_t next_due(int64_t now);
+    void run_due(int64_t now);
+    void error(int64_t now, const char *fmt, ...);
+
+    int fd;
+    std::string name;
+
+    FrameParser parser;
+    lsmessage_t msg;                    // The one being handled
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<emuchunk_t> chunks;
+    bool closed = false;
+    int64_t linkFree = 0;               // When the pretend link is done with what it has
+
+    std::vector<emuqueued_t> queue;
+    uint64_t queueSeq = 0;
+
+    emustats_t stats;
+};
+
+static std::mutex sessionLock;
+static std::vector<std::shared_ptr<EmuSession>> sessions;
+
+void EmuSession::error(int64_t now, const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    stats.errors++;
+    emulog(now, "ERROR %s", buf);
+    fprintf(stderr, "%s: %s\n", name.c_str(), buf);
+}
+
+void EmuSession::report(void)
+{
+    printf("%s: %llu bytes, %llu messages, %llu animates, %llu queued, %llu ran (worst %lld us late), %llu flushed, %llu errors\n",
+           name.c_str(),
+           (unsigned long long) stats.bytes, (unsigned long long) stats.messages,
+           (unsigned long long) stats.animates, (unsigned long long) stats.queued,
+           (unsigned long long) stats.ran, (long long) stats.worstLate,
+           (unsigned long long) stats.flushed, (unsigned long long) stats.errors);
+}
+
+// Take whatever the host sends as it arrives and work out when the board
+// would have it: each byte takes 1/linkRate to cross, then the latency.
+void EmuSession::reader(void)
+{
+    uint8_t buf[EMU_CHUNK];
+    ssize_t res;
+
+    for (;;) {
+        res = read(fd, buf, sizeof(buf));
+        if (res <= 0) {
+            if ((res < 0) && (errno == EINTR)) {
+                continue;
+            }
+            break;
+        }
+
+        int64_t now = micros();
+        std::lock_guard<std::mutex> guard(lock);
+        int64_t done = std::max(now, linkFree);
+
+        if (opts.linkRate > 0) {
+            done += (int64_t) ((double) res * 1000000.0 / opts.linkRate);
+        }
+        linkFree = done;
+        chunks.push_back({done + opts.latency, std::vector<uint8_t>(buf, buf + res)});
+        wake.notify_one();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    closed = true;
+    wake.notify_one();
+}
+
+void EmuSession::run(void)
+{
+    std::thread readThread(&EmuSession::reader, this);
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;) {
+        int64_t now = micros();
+        int64_t due = next_due(now);
+
+        if (!chunks.empty() && (chunks.front().deliver <= now)) {
+            emuchunk_t chunk = std::move(chunks.front());
+            chunks.pop_front();
+            guard.unlock();
+            receive(chunk.data.data(), chunk.data.size(), now);
+            guard.lock();
+            continue;
+        }
+        if (due <= now) {
+            guard.unlock();
+            run_due(now);
+            guard.lock();
+            continue;
+        }
+        if (closed && chunks.empty()) {
+            break;
+        }
+
+        if (!chunks.empty()) {
+            due = std::min(due, chunks.front().deliver);
+        }
+
+        // Sleep until shortly before the next thing, then spin, so queued
+        // commands run close to their time.
+        if (due - now > EMU_SPIN_USEC) {
+            if (due == INT64_MAX) {
+                wake.wait(guard);
+            } else {
+                wake.wait_until(guard, when_steady(due - EMU_SPIN_USEC));
+            }
+        } else {
+            guard.unlock();
+            while (micros() < due) {
+            }
+            guard.lock();
+        }
+    }
+
+    guard.unlock();
+    readThread.join();
+    close(fd);
+}
+
+// Feed bytes through the frame parser, handling each message as it completes.
+void EmuSession::receive(const uint8_t *buf, size_t len, int64_t now)
+{
+    stats.bytes += len;
+
+    while (len > 0) {
+        bool complete;
+        size_t n = parser.parse(buf, len, complete);
+
+        buf += n;
+        len -= n;
+        if (parser.badFrames) {
+            error(now, "skipped %u messages with too much payload", parser.badFrames);
+            parser.badFrames = 0;
+        }
+        if (complete) {
+            msg = parser.message();
+            stats.messages++;
+            handle(now);
+        }
+    }
+}
+
+// Send a response to the command in 'msg'.
+void EmuSession::respond(const void *payload, int len)
+{
+    uint8_t frame[2 + sizeof(lsmessage_t)];
+    const uint8_t *p = frame;
+    size_t left = 2 + LSMSG_HDRSIZE + len;
+    ssize_t res;
+
+    frame[0] = 0x02;
+    frame[1] = 0xAA;
+    frame[2] = msg.ls_command;
+    frame[3] = (uint8_t) len;
+    if (len) {
+        memcpy(&frame[2 + LSMSG_HDRSIZE], payload, len);
+    }
+
+    while (left > 0) {
+        res = write(fd, p, left);
+        if (res <= 0) {
+            if ((res < 0) && (errno == EINTR)) {
+                continue;
+            }
+            return;
+        }
+        p += res;
+        left -= res;
+    }
+}
+
+void EmuSession::eeprom_command(const lseeprom_t *req, lseeprom_t *resp)
+{
+    char data[LSEEPROM_MAXDATA + 1];
+    std::string out;
+
+    memcpy(data, req->le_data, LSEEPROM_MAXDATA);
+    data[LSEEPROM_MAXDATA] = 0;
+
+    memset(resp, 0, sizeof(*resp));
+    resp->le_subcmd = req->le_subcmd;
+
+    std::lock_guard<std::mutex> guard(boardLock);
+
+    switch (req->le_subcmd) {
+        case LSEEPROM_GETENV:
+            if (eeprom.count(data)) {
+                out = eeprom[data];
+            }
+            break;
+        case LSEEPROM_SETENV: {
+            char *eq = strchr(data, '=');
+            if (eq) {
+                *eq = 0;
+                if (eq[1]) {
+                    eeprom[data] = eq + 1;
+                } else {
+                    eeprom.erase(data);
+                }
+            }
+            break;
+        }
+        case LSEEPROM_PRINTENV:
+            for (const auto& e : eeprom) {
+                out += e.first + "=" + e.second + "\n";
+            }
+            break;
+        case LSEEPROM_ERASEALL:
+            eeprom.clear();
+            break;
+    }
+
+    strncpy((char *) resp->le_data, out.c_str(), LSEEPROM_MAXDATA - 1);
+}
+
+// The message in 'msg' is complete, do what the board would.
+void EmuSession::handle(int64_t now)
+{
+    uint8_t cmd = msg.ls_command;
+    bool v3 = (opts.protocol >= PICOLIGHT_PROTOCOL_ANIMATE_AT);
+    bool v4 = (opts.protocol >= PICOLIGHT_PROTOCOL_CONFIGHASH);
+
+    switch (cmd) {
+        case LSCMD_ANIMATE:
+            if (msg.ls_length != sizeof(lsanimate_t)) {
+                error(now, "ANIMATE with a %u byte payload", msg.ls_length);
+                break;
+            }
+            stats.animates++;
+            log_animate(now, "ANIMATE", &msg.info.ls_animate, "");
+            break;
+
+        case LSCMD_BRIGHTNESS:
+            emulog(now, "BRIGHTNESS");
+            break;
+
+        case LSCMD_IDLE:
+            emulog(now, "IDLE");
+            break;
+
+        case LSCMD_ANIMATE_AT:
+            if (!v3) goto unknown;
+            if (msg.ls_length != sizeof(lsanimateat_t)) {
+                error(now, "ANIMATE_AT with a %u byte payload", msg.ls_length);
+                break;
+            }
+            if ((int) queue.size() >= opts.queueSize) {
+                error(now, "queue full, ANIMATE_AT for %u dropped", msg.info.ls_animateat.laa_time);
+                break;
+            }
+            stats.queued++;
+            queue.push_back({msg.info.ls_animateat.laa_time, queueSeq++, msg.info.ls_animateat.laa_animate});
+            emulog(now, "QUEUE at %u (%d us ahead)", msg.info.ls_animateat.laa_time,
+                   (int32_t) (msg.info.ls_animateat.laa_time - (uint32_t) now));
+            break;
+
+        case LSCMD_FLUSH:
+            if (!v3) goto unknown;
+            stats.flushed += queue.size();
+            emulog(now, "FLUSH %u queued", (unsigned) queue.size());
+            queue.clear();
+            break;
+
+        case LSCMD_VERSION: {
+            lsversion_t v = { (uint8_t) opts.protocol, EMU_FW_MAJOR, EMU_FW_MINOR, PICOHW_TYPE_PICOLIGHT };
+            emulog(now, "VERSION");
+            respond(&v, sizeof(v));
+            break;
+        }
+
+        case LSCMD_STATUS: {
+            lsstatus_t s;
+            std::lock_guard<std::mutex> guard(boardLock);
+            s.ls_status = initialized ? 1 : 0;
+            s.ls_confighash = configHash;
+            emulog(now, "STATUS");
+            // Older boards only have the status word.
+            respond(&s, v4 ? sizeof(s) : sizeof(s.ls_status));
+            break;
+        }
+
+        case LSCMD_RESET: {
+            std::lock_guard<std::mutex> guard(boardLock);
+            memset(pstrips, 0, sizeof(pstrips));
+            memset(vstrips, 0, sizeof(vstrips));
+            vstripCount = 0;
+            initialized = false;
+            configHash = 0;
+            emulog(now, "RESET");
+            respond(NULL, 0);
+            break;
+        }
+
+        case LSCMD_SETPSTRIP: {
+            uint32_t info = msg.info.ls_pstrip.lp_pstrip;
+            std::lock_guard<std::mutex> guard(boardLock);
+            pstrips[PSTRIP_CHAN(info)] = info;
+            emulog(now, "SETPSTRIP chan %u type %u count %u", PSTRIP_CHAN(info), PSTRIP_TYPE(info), PSTRIP_COUNT(info));
+            respond(NULL, 0);
+            break;
+        }
+
+        case LSCMD_SETVSTRIP: {
+            const lsvstrip_t *vs = &msg.info.ls_vstrip;
+            std::lock_guard<std::mutex> guard(boardLock);
+            if ((vs->lv_idx >= MAXVSTRIPS) || (vs->lv_count > MAXSUBSTRIPS)) {
+                error(now, "SETVSTRIP %u with %u substrips", vs->lv_idx, vs->lv_count);
+            } else {
+                vstrips[vs->lv_idx] = *vs;
+                vstripCount = std::max(vstripCount, vs->lv_idx + 1);
+                for (int i = 0; i < vs->lv_count; i++) {
+                    if (PSTRIP_COUNT(pstrips[SUBSTRIP_CHAN(vs->lv_substrips[i])]) == 0) {
+                        error(now, "SETVSTRIP %u uses physical strip %u, which isn't set", vs->lv_idx, SUBSTRIP_CHAN(vs->lv_substrips[i]));
+                    }
+                }
+                emulog(now, "SETVSTRIP %u count %u", vs->lv_idx, vs->lv_count);
+            }
+            respond(NULL, 0);
+            break;
+        }
+
+        case LSCMD_INIT: {
+            std::lock_guard<std::mutex> guard(boardLock);
+            initialized = true;
+            configHash = (v4 && (msg.ls_length >= sizeof(lsinit_t))) ? msg.info.ls_init.li_confighash : 0;
+            emulog(now, "INIT %d virtual strips, config %08X", vstripCount, configHash);
+            respond(NULL, 0);
+            break;
+        }
+
+        case LSCMD_EEPROM: {
+            lseeprom_t resp;
+            eeprom_command(&msg.info.ls_eeprom, &resp);
+            emulog(now, "EEPROM %u", msg.info.ls_eeprom.le_subcmd);
+            respond(&resp, sizeof(resp));
+            break;
+        }
+
+        case LSCMD_DFU:
+            emulog(now, "DFU");
+            respond(NULL, 0);
+            break;
+
+        case LSCMD_CLOCK: {
+            if (!v3) goto unknown;
+            lsclock_t c;
+            c.lc_time = (uint32_t) micros();
+            c.lc_queuesize = (uint16_t) opts.queueSize;
+            emulog(now, "CLOCK");
+            respond(&c, sizeof(c));
+            break;
+        }
+
+        default:
+        unknown:
+            error(now, "unknown command %02X", cmd);
+            if (cmd & 0x80) {
+                respond(NULL, 0);
+            }
+            break;
+    }
+}
+
+// Microseconds when the next queued command is due, INT64_MAX if none.
+// Board times wrap, so they're compared by difference from now.
+int64_t EmuSession::next_due(int64_t now)
+{
+    int64_t due = INT64_MAX;
+
+    for (const emuqueued_t& q : queue) {
+        due = std::min(due, now + (int32_t) (q.when - (uint32_t) now));
+    }
+    return due;
+}
+
+// Run the queued commands whose time has come, oldest first.
+void EmuSession::run_due(int64_t now)
+{
+    for (;;) {
+        int best = -1;
+        int32_t bestLate = 0;
+
+        for (size_t i = 0; i < queue.size(); i++) {
+            int32_t late = (int32_t) ((uint32_t) now - queue[i].when);
+            if ((late >= 0) && ((best < 0) || (late > bestLate) ||
+                                ((late == bestLate) && (queue[i].seq < queue[best].seq)))) {
+                best = (int) i;
+                bestLate = late;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+
+        char extra[48];
+        snprintf(extra, sizeof(extra), " late %d us", bestLate);
+        stats.ran++;
+        stats.animates++;
+        stats.worstLate = std::max(stats.worstLate, (int64_t) bestLate);
+        log_animate(now, "RUN", &queue[best].anim, extra);
+        queue.erase(queue.begin() + best);
+    }
+}
+
+static void serve(int fd, std::string name)
+{
+    std::shared_ptr<EmuSession> session = std::make_shared<EmuSession>(fd, name);
+
+    {
+        std::lock_guard<std::mutex> guard(sessionLock);
+        sessions.push_back(session);
+    }
+    printf("%s: connected\n", name.c_str());
+    session->run();
+    session->report();
+}
+
+// Accept one host at a time, as a board would.
+static void tcp_listener(int lfd)
+{
+    for (;;) {
+        struct sockaddr_in sin;
+        socklen_t slen = sizeof(sin);
+        int fd = accept(lfd, (struct sockaddr *) &sin, &slen);
+        int flags = 1;
+
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            return;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+        serve(fd, std::string("tcp ") + inet_ntoa(sin.sin_addr));
+    }
+}
+
+static int open_tcp(const char *addr)
+{
+    struct sockaddr_in sin;
+    int flags = 1;
+    int fd;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(EMU_PORT);
+    if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+        fprintf(stderr, "Not an IPv4 address: %s\n", addr);
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags));
+    if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+        fprintf(stderr, "Could not listen on %s port %d: %s\n", addr, EMU_PORT, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    listen(fd, 4);
+
+    printf("Listening on %s port %d\n", addr, EMU_PORT);
+    return fd;
+}
+
+// A pseudo-terminal stands in for the USB serial port.  We keep the other
+// end open ourselves so the host can come and go without the master seeing
+// a hangup.
+static int open_pty(void)
+{
+    struct termios tio;
+    int master, slave;
+    char *name;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master < 0) || (grantpt(master) < 0) || (unlockpt(master) < 0) || ((name = ptsname(master)) == NULL)) {
+        perror("pseudo-terminal");
+        return -1;
+    }
+
+    slave = open(name, O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        perror(name);
+        return -1;
+    }
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    printf("Serial port is %s\n", name);
+    return master;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,"Usage: picoemu [-a addr] [-n] [-t] [-P protocol] [-q size] [-b rate] [-r usec] [-o file]\n\n");
+    fprintf(stderr,"    -a addr             Listen for playback on this address, port %d, default 127.0.0.1\n", EMU_PORT);
+    fprintf(stderr,"    -n                  Don't listen on the network\n");
+    fprintf(stderr,"    -t                  Also be a serial port on a pseudo-terminal, its name is printed\n");
+    fprintf(stderr,"    -P protocol         Protocol version to report, default %d\n", PICOLIGHT_PROTOCOL_VERSION);
+    fprintf(stderr,"    -q size             Commands that can be queued to run later, default %d\n", EMU_QUEUE_DEFAULT);
+    fprintf(stderr,"    -b rate             Link speed in bytes/sec, default as fast as the host sends\n");
+    fprintf(stderr,"    -r usec             Delay everything the host sends by this much\n");
+    fprintf(stderr,"    -o file             Log every message with the time it arrived, '-' for stdout\n");
+    fprintf(stderr,"\n");
+    fprintf(stderr,"    Interrupt to stop; a summary of each connection is printed.\n");
+    fprintf(stderr,"\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    char *logfilename = NULL;
+    std::vector<std::thread> threads;
+    sigset_t sigs;
+    int sig;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "a:ntP:q:b:r:o:")) != -1) {
+        switch (ch) {
+            case 'a':
+                opts.tcpAddr = optarg;
+                break;
+            case 'n':
+                opts.tcpAddr = NULL;
+                break;
+            case 't':
+                opts.pty = true;
+                break;
+            case 'P':
+                opts.protocol = atoi(optarg);
+                break;
+            case 'q':
+                opts.queueSize = atoi(optarg);
+                break;
+            case 'b':
+                opts.linkRate = atof(optarg);
+                break;
+            case 'r':
+                opts.latency = atoll(optarg);
+                break;
+            case 'o':
+                logfilename = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if ((opts.tcpAddr == NULL) && !opts.pty) {
+        usage();
+    }
+
+    if (logfilename) {
+        logfile = (strcmp(logfilename, "-") == 0) ? stdout : fopen(logfilename, "w");
+        if (logfile == NULL) {
+            fprintf(stderr,"Could not open %s : %s\n", logfilename, strerror(errno));
+            exit(1);
+        }
+    }
+
+    printf("Picolight emulator version %s, protocol %d\n", VERSION, opts.protocol);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Handle interrupts on this thread only, the others just work.
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (opts.tcpAddr) {
+        int lfd = open_tcp(opts.tcpAddr);
+        if (lfd < 0) {
+            exit(1);
+        }
+        threads.emplace_back(tcp_listener, lfd);
+    }
+    if (opts.pty) {
+        int pfd = open_pty();
+        if (pfd < 0) {
+            exit(1);
+        }
+        threads.emplace_back(serve, pfd, std::string("serial"));
+    }
+
+    sigwait(&sigs, &sig);
+
+    {
+        std::lock_guard<std::mutex> guard(sessionLock);
+        printf("\n");
+        for (auto& s : sessions) {
+            s->report();
+        }
+    }
+    if (logfile) {
+        std::lock_guard<std::mutex> guard(logLock);
+        fflush(logfile);
+    }
+
+    // The threads are blocked in reads, just leave.
+    _exit(0);
+}
@@ -1,7 +1,18 @@
 #ifndef _PICOPROTOCOL_H_
 #define _PICOPROTOCOL_H_
 
-#define PICOLIGHT_PROTOCOL_VERSION      2
+#define PICOLIGHT_PROTOCOL_VERSION      4
+
+// Protocol 3 adds LSCMD_ANIMATE_AT, LSCMD_FLUSH and LSCMD_CLOCK, so the host
+// can send animations ahead of time and have the board run them on its own
+// clock.  Hosts fall back to LSCMD_ANIMATE for older boards.
+#define PICOLIGHT_PROTOCOL_ANIMATE_AT   3
+
+// Protocol 4 lets LSCMD_INIT carry a hash of the configuration just sent,
+// and LSCMD_STATUS returns it, so the host can tell when the board already
+// has the panel it is about to upload.  The board keeps it with the
+// configuration, so it is gone after a power cycle or LSCMD_RESET.
+#define PICOLIGHT_PROTOCOL_CONFIGHASH   4
 
 // Board types
 
@@ -48,6 +59,8 @@
 #define LSCMD_ANIMATE           0               // Send an animation command
 #define LSCMD_BRIGHTNESS        1               // Send a global brightness command
 #define LSCMD_IDLE              2               // Idle the panel
+#define LSCMD_ANIMATE_AT        3               // Queue an animation command to run at a board time
+#define LSCMD_FLUSH             4               // Throw away queued LSCMD_ANIMATE_AT commands
 
 #define LSCMD_VERSION           0x80            // Firmware version
 #define LSCMD_STATUS            0x81            // Return info about current setup
@@ -57,6 +70,7 @@
 #define LSCMD_INIT              0x85            // Initialize with programmed parameters.
 #define LSCMD_EEPROM            0x86            // EEPROM
 #define LSCMD_DFU               0x87            // DFU
+#define LSCMD_CLOCK             0x88            // Return the board's clock and queue size
 
 typedef struct __attribute__((packed)) lsanimate_s {
     uint16_t    la_anim;
@@ -66,6 +80,18 @@ typedef struct __attribute__((packed)) lsanimate_s {
     uint32_t    la_strips[MAXVSTRIPS/32];
 } lsanimate_t;
 
+// Board times are microseconds on a free-running 32 bit counter, compared
+// with wraparound.  A command whose time has already passed runs at once.
+typedef struct __attribute__((packed)) lsanimateat_s {
+    uint32_t    laa_time;               // Board time to run it
+    lsanimate_t laa_animate;
+} lsanimateat_t;
+
+typedef struct __attribute__((packed)) lsclock_s {
+    uint32_t    lc_time;                // Board time now
+    uint16_t    lc_queuesize;           // How many LSCMD_ANIMATE_AT commands it can hold
+} lsclock_t;
+
 typedef struct __attribute__((packed)) lsversion_s {
     uint8_t lv_protocol;
     uint8_t lv_major;
@@ -75,8 +101,13 @@ typedef struct __attribute__((packed)) lsversion_s {
 
 typedef struct __attribute__((packed)) lsstatus_s {
     uint32_t ls_status;
+    uint32_t ls_confighash;             // From the last LSCMD_INIT, 0 if none (protocol 4)
 } lsstatus_t;
 
+typedef struct __attribute__((packed)) lsinit_s {
+    uint32_t li_confighash;             // Never 0 (protocol 4, optional)
+} lsinit_t;
+
 typedef struct __attribute__((packed)) lspstrip_s {
     uint32_t lp_pstrip;
 } lspstrip_t;
@@ -103,8 +134,11 @@ typedef struct __attribute__((packed)) lsmessage_s {
     uint8_t     ls_length;              // number of bytes of payload
     union {                             // payload
         lsanimate_t ls_animate;
+        lsanimateat_t ls_animateat;
+        lsclock_t ls_clock;
         lsversion_t ls_version;
         lsstatus_t ls_status;
+        lsinit_t ls_init;
         lspstrip_t ls_pstrip;
         lsvstrip_t ls_vstrip;
         lseeprom_t ls_eeprom;
@@ -1,11 +1,101 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "playclock.hpp"
+#include "logring.hpp"
+#include "framereader.hpp"
+
+//
+// A replacement script and schedule to switch to while playing.  The
+// playback thread picks it up between events and then publishes 'epoch'
+// in adoptedEpoch, after which anything older can be freed.
+//
+typedef struct playswap_s {
+    LSScript *script;
+    LSSchedule *sched;
+    uint64_t epoch;
+} playswap_t;
+
+//
+// Event log lines are handed from the playback thread to a logging thread,
+// which does the slow part (printing them).  If the logger falls behind,
+// lines are dropped rather than holding up playback.
+//
+#define LOGRING_SIZE    256             // Power of two
+
+static_assert(LSLOGLINE_MAX <= LSLOGREC_TEXT, "event log lines must fit in a log record");
+
+//
+// Playback sleeps until shortly before each event and busy-waits for the
+// last little bit, since waking from a sleep is only accurate to a fraction
+// of a millisecond.  The spin window trades CPU for accuracy.
+//
+#define PLAYSPIN_DEFAULT    0.0005      // Seconds to spin before each event
+#define PLAYSLEEP_MAX       0.01        // Longest single sleep, seconds
+
+//
+// Boards on protocol 3 or later can hold animate commands and run them on
+// their own clock, so playback sends events up to the send-ahead window
+// early and host scheduling no longer matters.  The clocks are matched
+// with a few round trips at the start and again every so often to follow
+// drift.
+//
+#define PLAYAHEAD_DEFAULT   0.1         // Seconds to send ahead, 0 for off
+#define PLAYAHEAD_ROUNDS    8           // Round trips per clock sync, the fastest wins
+#define PLAYAHEAD_RESYNC    10.0        // Seconds between clock syncs
+
+//
+// The panel configuration goes to the board as a run of commands that are
+// each answered.  Rather than wait for every answer before sending the
+// next, up to PLAYUPLOAD_WINDOW are sent ahead; the board handles them in
+// order, so the answers come back in the same order.
+//
+#define PLAYUPLOAD_WINDOW   8           // Commands waiting for an answer
+
+// How late events were sent, in seconds.  Events queued on a board ahead
+// of time are only counted.
+typedef struct playjitter_s {
+    int count;
+    double sum;
+    double sumsq;
+    double max;
+    int ahead;
+} playjitter_t;
+
+//
+// Every event playback sends is noted in a ring: when it was due, when
+// the write to the board finished and how many bytes went.  The ring is
+// allocated up front and costs a store per event and a clock read per
+// write.  A long show keeps its last PLAYLAT_RECORDS events.
+//
+#define PLAYLAT_RECORDS     65536       // Power of two
+#define PLAYLAT_BUCKETS     12          // Histogram buckets, see latencyBuckets
+#define PLAYLAT_WORST       10          // Source lines to name in the report
+
+typedef struct playsend_s {
+    lstick_t due;                       // Show time it was due
+    int64_t sent;                       // Show time in ns when the write finished
+    int line;                           // Source line
+    uint16_t bytes;                     // Bytes written for it
+    uint8_t board;
+    uint8_t ahead;                      // Queued on the board, so 'sent' is early
+} playsend_t;
+
+typedef struct playlatency_s {
+    int events;                         // Sent when due, from the ring
+    int ahead;                          // Queued on the boards ahead of time
+    uint64_t bytes;
+    double p50, p90, p99, max;          // Seconds late
+    double minLead;                     // Least time an event was queued ahead
+    int hist[PLAYLAT_BUCKETS];
+    std::vector<std::pair<int,double>> worst;   // Source line and its latest event
+} playlatency_t;
 
 class Playback {
 public:
@@ -31,10 +121,26 @@ public:
     int reset_to_dfu(void);
 
     void set_time_callback(void (*callback)(void *arg,double), void *arg);
+    void set_logging(bool enable);
+    void set_spin_window(double secs);
+    void set_send_ahead(double secs);
+
+    // How late events went out on the last run.  Only while not playing.
+    const playlatency_t& latency_report(void) { return latency; }
+    void print_latency(void);
+    std::string latency_json(void);
+
+    // Use another clock, for testing.  NULL goes back to the built-in ones.
+    void set_clock(PlaybackClock *c);
+
+    void play_swap(playswap_t *swap);
+    uint64_t play_epoch(void);
+    bool play_running(void);
 
 private:
     int device;
-    time_t epoch;
+    int boardDevices[LSMAXBOARDS];      // Boards after the first, which uses 'device'
+    FrameReader rx[LSMAXBOARDS];        // Responses from each board
     int offAnim;
     double start_offset;
     bool play_please_stop;
@@ -44,24 +150,82 @@ private:
     void *time_callback_arg;
     std::string scriptDirectory;
 
-    int musicpos;
-    int musicend;
+    const schedcmd_t *musiccmd;
     LSScript *curscript;
     LSSchedule *cursched;
+    lstick_t lastsent;
+    double spinWindow = PLAYSPIN_DEFAULT;
+
+    bool batching = false;              // Collect animate frames in txBatch
+    std::vector<uint8_t> txBatch[LSMAXBOARDS];
+
+    double aheadWindow = PLAYAHEAD_DEFAULT;
+    bool aheadActive = false;           // Sending ahead right now
+    int boardProtocol[LSMAXBOARDS];
+    bool ahead[LSMAXBOARDS];            // Board can queue events
+    uint32_t aheadQueue[LSMAXBOARDS];   // How many it can hold
+    std::deque<lstick_t> aheadDue[LSMAXBOARDS]; // Queued events that haven't run yet
+    uint32_t boardClock[LSMAXBOARDS];   // Board time at hostClock, from the last sync
+    double hostClock[LSMAXBOARDS];
+    double showBase;                    // Playback clock at show time zero
+    double lastSync;                    // Show time of the last sync
+
+    MonotonicClock monoClock;
+    AudioClock audioClock;
+    PlaybackClock *clock = &monoClock;  // The one in use
+    PlaybackClock *userClock = nullptr;
+
+    bool logging = true;
+    LogRing<LOGRING_SIZE> eventLog;
+    std::atomic<bool> logStop{false};
+    uint32_t logDropped;
+    std::thread logThread;
+
+    playjitter_t jitter;
+    std::vector<playsend_t> sends;      // PLAYLAT_RECORDS of them
+    uint64_t sendCount;                 // Ever written to 'sends'
+    playlatency_t latency;
+
+    std::atomic<playswap_t *> pendingSwap{nullptr};
+    std::atomic<uint64_t> adoptedEpoch{0};
+    std::atomic<bool> running{false};
 
 public:
-    int player_callback(double curTime);
+    void set_audio_position(double secs);
+    int player_callback(void);
 
 private:
-    int play_openusbdevice(char *devname);
-    int play_opentcpdevice(char *hostaddr);
-
-    void all_off(void);
+    int play_openusbdevice(char *devname, int *fd);
+    int play_opentcpdevice(char *hostaddr, int *fd);
+    int play_openboards(void);
+    int board_device(int board);
+    int recv_response(int fd, lsmessage_t *msg);
+
+    int board_version(int fd, lsversion_t *version);
+    uint32_t board_confighash(int fd);
+    bool sync_clock(int board);
+    void start_ahead(double now);
+    void stop_ahead(void);
+    double send_time(const schedcmd_t *cmd, double now);
+    bool send_ahead(LSSchedule *sched, const schedcmd_t *cmd);
+
+    void all_off(bool settle);
+    void send_event(LSSchedule *sched, const schedcmd_t *cmd);
+    const schedcmd_t *send_due(LSSchedule *sched, const schedcmd_t *cmd, double now);
+    void flush_batch(void);
+    void log_event(LSSchedule *sched, const schedcmd_t *cmd);
+    void log_run(void);
+    void note_send(const schedcmd_t *cmd, int bytes, bool queued);
+    void stamp_sends(uint64_t first);
+    void build_latency(void);
+    void report_jitter(void);
+    void restore_state(LSSchedule *sched, double start_cue);
+    bool take_swap(double now);
     void play_idle(void);
     void play_events(LSSchedule *sched, double start_cue, double end_cue);
     void play_music(LSSchedule *sched, double start_cue, double end_cue, std::string music);
-    double current_time(void);
-    int upload_config(LSScript *script);
+    int upload_config(int board);
+    int send_pipelined(int fd, const std::vector<lsmessage_t>& msgs);
     void run(void);
 
 private:
@@ -20,6 +20,9 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <algorithm>
+#include <math.h>
 #include "schedule.hpp"
 #include "symtab.hpp"
 
@@ -44,14 +47,23 @@
 Playback::Playback()
 {
     device = -1;
-    epoch = 0;
+    for (int b = 0; b < LSMAXBOARDS; b++) {
+        boardDevices[b] = -1;
+        boardProtocol[b] = 0;
+        ahead[b] = false;
+        aheadQueue[b] = 0;
+    }
+    showBase = 0;
+    lastSync = 0;
+    sends.resize(PLAYLAT_RECORDS);
+    sendCount = 0;
     offAnim = 0;
     start_offset = 0;
     play_please_stop = false;
-    musicpos = 0;
-    musicend = 0;
+    musiccmd = NULL;
     curscript = NULL;
     cursched = NULL;
+    lastsent = 0;
 }
 
 Playback::~Playback()
@@ -92,8 +104,8 @@ static int playMusicFile(const char *filename, Playback *player, double start_cu
         }
 
         while (audioPlayer.playing) {
-            NSTimeInterval playTime = [audioPlayer currentTime];
-            if (player->player_callback(playTime) == 0) {
+            player->set_audio_position([audioPlayer currentTime]);
+            if (player->player_callback() == 0) {
                 break;
             }
             [NSThread sleepForTimeInterval:0.01];
@@ -161,202 +173,163 @@ static void msleep(int ms)
     nanosleep(&ts,NULL);
 }
 
-double Playback::current_time(void)
-{
-    struct timeval tv;
 
-    gettimeofday(&tv,NULL);
 
-    return ((double) (tv.tv_sec - epoch)) + ((double)(tv.tv_usec)/1000000.0);
-}
+static void send_animate(int device, const StripMask& strips, uint16_t anim,  uint16_t speed, uint16_t option, uint32_t color)
+{
+    lsmessage_t msg;
 
+    animate_message(&msg, strips, anim, speed, option, color);
+    send_command(device, &msg);
+}
 
-static int send_command(int device, lsmessage_t *msg)
+void Playback::play_setdir(std::string dir)
 {
-    uint8_t sync[2];
-    int txlen;
+    scriptDirectory = dir;
+}
 
-    if (device <= 0) {
-        return -1;
-    }
+// private
+// Ask a board what it is.  Returns its protocol version, or 0 if there's
+// no board or it doesn't answer.
+int Playback::board_version(int fd, lsversion_t *version)
+{
+    lsmessage_t msg;
 
-    sync[0] = 0x02;
-    sync[1] = 0xAA;
-    if (write(device, sync, sizeof(sync)) != sizeof(sync)) {
-        perror("Write Error to Picolight [sync]");
-        exit(1);
-    }
+    memset(version, 0, sizeof(*version));
 
-    txlen = LSMSG_HDRSIZE + msg->ls_length;
+    msg.ls_command = LSCMD_VERSION;
+    msg.ls_length = 0;
 
-    if (write(device, msg, txlen) != txlen) {
-        perror("Write Error to Picolight [cmd]");
-        exit(1);
+    if ((send_command(fd, &msg) < 0) || (recv_response(fd, &msg) < 0)) {
+        return 0;
     }
 
-    return 0;
+    *version = msg.info.ls_version;
+    return version->lv_protocol;
 }
 
-static ssize_t readdata(int device, uint8_t *buf, int len)
+// private
+// The hash the board was given with its configuration, or 0 if it has none
+// or can't say.
+uint32_t Playback::board_confighash(int fd)
 {
-    ssize_t res;
-    int ttl = 0;
+    lsmessage_t msg;
 
-    while (len > 0) {
-        res = read(device, buf, len);
-        if (res <= 0) {
-            lsprinterr("Read error from PicoLight: %d\n",res);
-            exit(1);
-        }
-        buf += res;
-        len -= res;
-        ttl += res;
+    msg.ls_command = LSCMD_STATUS;
+    msg.ls_length = 0;
+
+    if ((send_command(fd, &msg) < 0) || (recv_response(fd, &msg) < 0)) {
+        return 0;
+    }
+    if ((msg.ls_command != LSCMD_STATUS) || (msg.ls_length < sizeof(lsstatus_t))) {
+        return 0;
     }
 
-    return ttl;
+    return msg.info.ls_status.ls_confighash;
 }
 
-
-#define STATE_SYNC1 0
-#define STATE_SYNC2 1
-static ssize_t recv_response(int device, lsmessage_t *msg)
+void Playback::check_version(void)
 {
-    uint8_t b;
-    ssize_t res;
-    int reading = 1;
-    int state = STATE_SYNC1;
+    lsversion_t v;
 
-    if (device <= 0) {
-        return -1;
-    }
+    boardProtocol[0] = board_version(device, &v);
+
+    lsprintf("Protocol version: %u     Firmware Version %u.%u    Hardware %u\n",
+           v.lv_protocol,
+           v.lv_major,
+           v.lv_minor,
+           v.lv_hwtype);
+}
 
-    #if 0
-    for (;;) {
-        if (readdata(device, &b,1) == 1) { printf("%02X ",b); fflush(stdout);}
-        else {
-            printf("read error\n");
-            exit(1);
-        }
-    }
-    #endif
 
-    while (reading) {
-        if (readdata(device, &b,1) < 1) {
-            printf("Read error from Picolight [sync]\n");
-            exit(1);
+// private
+// Send the commands in 'msgs' and check each is answered, keeping up to
+// PLAYUPLOAD_WINDOW of them in flight.  Returns 0, or -1 if the board
+// doesn't answer or answers the wrong thing.
+int Playback::send_pipelined(int fd, const std::vector<lsmessage_t>& msgs)
+{
+    std::vector<uint8_t> tx;
+    lsmessage_t rxMessage;
+    size_t sent = 0;
+    size_t answered = 0;
+
+    tx.reserve(PLAYUPLOAD_WINDOW * LSFRAME_MAX);
+
+    while (answered < msgs.size()) {
+        // Top up the window in one write.
+        tx.clear();
+        while ((sent < msgs.size()) && (sent - answered < PLAYUPLOAD_WINDOW)) {
+            size_t used = tx.size();
+            tx.resize(used + LSFRAME_MAX);
+            tx.resize(used + frame_message(&tx[used], &msgs[sent]));
+            sent++;
         }
-        switch (state) {
-            case STATE_SYNC1:
-                if (b == 0x02) {
-                    state = STATE_SYNC2;
-                }
-                break;
-            case STATE_SYNC2:
-                if (b == 0xAA) {
-                    reading = 0;
-                } else {
-                    state = STATE_SYNC1;
-                }
+        if (!tx.empty() && (write_frames(fd, tx.data(), tx.size()) < 0)) {
+            return -1;
         }
-    }
-
-    memset(msg,0,sizeof(lsmessage_t));
-
-    if (readdata(device,(uint8_t *) msg,LSMSG_HDRSIZE) != LSMSG_HDRSIZE) {
-        printf("Read error from Picolight [hdr]\n");
-            exit(1);
-    }
-
-    int rxlen = msg->ls_length;
 
-    if (rxlen != 0) {
-        if ((res = readdata(device,(uint8_t *) &(msg->info), rxlen)) != rxlen) {
-            printf("Read error from Picolight [payload] %ld\n",res);
-            exit(1);
+        if (recv_response(fd, &rxMessage) < 0) {
+            return -1;
+        }
+        if (rxMessage.ls_command != msgs[answered].ls_command) {
+            lsprinterr("The PicoLight answered command %02X with %02X", msgs[answered].ls_command, rxMessage.ls_command);
+            return -1;
         }
+        answered++;
     }
 
     return 0;
-            
 }
 
-static void send_animate(int device, uint32_t *strips, uint16_t anim,  uint16_t speed, uint16_t option, uint32_t color)
+// FNV-1a over the messages as they go on the wire.  0 means "no
+// configuration" to the board, so it is never the answer.
+static uint32_t config_hash(const std::vector<lsmessage_t>& msgs)
 {
-    lsmessage_t msg;
+    uint32_t h = 2166136261u;
 
-    memset(&msg,0,sizeof(msg));
-
-    for (int i = 0; i < MAXVSTRIPS/32; i++) {
-        msg.info.ls_animate.la_strips[i] = strips[i];
+    for (const lsmessage_t& m : msgs) {
+        const uint8_t *p = (const uint8_t *) &m;
+        for (int i = 0; i < LSMSG_HDRSIZE + m.ls_length; i++) {
+            h = (h ^ p[i]) * 16777619u;
+        }
     }
 
-    msg.info.ls_animate.la_anim = anim;
-    msg.info.ls_animate.la_speed = speed;
-    msg.info.ls_animate.la_option = option;
-    msg.info.ls_animate.la_color = color;
-    msg.ls_length = sizeof(lsanimate_t);
-    msg.ls_command = LSCMD_ANIMATE;
-
-    send_command(device, &msg);
-}
-
-void Playback::play_setdir(std::string dir)
-{
-    scriptDirectory = dir;
-}
-
-void Playback::check_version(void)
-{
-    lsmessage_t msg;
-
-    msg.ls_command = LSCMD_VERSION;
-    msg.ls_length = 0;
-
-    send_command(device, &msg);
-    recv_response(device, &msg);
-
-    lsprintf("Protocol version: %u     Firmware Version %u.%u    Hardware %u\n",
-           msg.info.ls_version.lv_protocol,
-           msg.info.ls_version.lv_major,
-           msg.info.ls_version.lv_minor,
-           msg.info.ls_version.lv_hwtype);
+    return (h == 0) ? 1 : h;
 }
 
-
 // private
-int Playback::upload_config(LSScript *script)
+// Returns 1 if the board already had this configuration and nothing was
+// sent, 0 if it was uploaded, -1 if the upload failed.
+int Playback::upload_config(int b)
 {
+    LSBoard *board = &curscript->boards[b];
+    int fd = board_device(b);
+    std::vector<lsmessage_t> msgs;
     lsmessage_t txMessage;
-    lsmessage_t rxMessage;
+    uint32_t hash;
+    int pcount = 0;
     int i;
 
-    lsprintf("Resetting panel");
-    // Send a RESET command
+    // RESET, then the physical strips, the virtual strips and INIT.
     memset(&txMessage,0,sizeof(txMessage));
     txMessage.ls_command = LSCMD_RESET;
     txMessage.ls_length = 0;
-    send_command(device, &txMessage);
-    recv_response(device, &rxMessage);
+    msgs.push_back(txMessage);
 
-    lsprintf("Sending physical strips");
-    // Send over the physical strips
     for (i = 0; i < MAXPSTRIPS; i++) {
-        uint32_t info = script->physicalStrips[i].info;
+        uint32_t info = board->physicalStrips[i].info;
         if (PSTRIP_COUNT(info) > 0) {
             memset(&txMessage,0,sizeof(txMessage));
             txMessage.ls_command = LSCMD_SETPSTRIP;
             txMessage.ls_length = sizeof(lspstrip_t);
             txMessage.info.ls_pstrip.lp_pstrip = info;
-            send_command(device, &txMessage);
-            recv_response(device, &rxMessage);
+            msgs.push_back(txMessage);
+            pcount++;
         }
     }
-            
 
-    lsprintf("Sending virtual strips");
-    // Send over the logical strips
-    for (i = 0; i < script->virtualStripCount; i++) {
-        VStrip_t *vstrip = &script->virtualStrips[i];
+    for (i = 0; i < board->virtualStripCount; i++) {
+        VStrip_t *vstrip = &board->virtualStrips[i];
         memset(&txMessage,0,sizeof(txMessage));
         txMessage.ls_command = LSCMD_SETVSTRIP;
         txMessage.ls_length = sizeof(lsvstrip_t);
@@ -365,22 +338,35 @@ int Playback::upload_config(LSScript *script)
         memcpy(txMessage.info.ls_vstrip.lv_substrips,
                vstrip->substrips,
                vstrip->substripCount * sizeof(uint32_t));
-        send_command(device, &txMessage);
-        recv_response(device, &rxMessage);
+        msgs.push_back(txMessage);
     }
-            
-    lsprintf("Initializing panel with new config");
-    // Send the INIT command
+
+    hash = config_hash(msgs);
+
+    // Newer boards remember the hash, and if it's what they have now
+    // there's nothing to send.
     memset(&txMessage,0,sizeof(txMessage));
     txMessage.ls_command = LSCMD_INIT;
     txMessage.ls_length = 0;
-    send_command(device, &txMessage);
-    recv_response(device, &rxMessage);
+    if (boardProtocol[b] >= PICOLIGHT_PROTOCOL_CONFIGHASH) {
+        if (board_confighash(fd) == hash) {
+            lsprintf("Board %s already has this panel configuration", board->name.empty() ? "default" : board->name.c_str());
+            return 1;
+        }
+        txMessage.ls_length = sizeof(lsinit_t);
+        txMessage.info.ls_init.li_confighash = hash;
+    }
+    msgs.push_back(txMessage);
+
+    lsprintf("Configuring panel: %d physical strips, %d virtual strips", pcount, board->virtualStripCount);
+    if (send_pipelined(fd, msgs) < 0) {
+        return -1;
+    }
+    lsprintf("Initialized panel with new config");
 
     return 0;
 }
 
-
 int Playback::env_getenv(char *name, char *val, int vallen)
 {
     lsmessage_t txMessage;
@@ -391,7 +377,9 @@ int Playback::env_getenv(char *name, char *val, int vallen)
     txMessage.info.ls_eeprom.le_subcmd = LSEEPROM_GETENV;
     strncpy((char *) txMessage.info.ls_eeprom.le_data, name, LSEEPROM_MAXDATA);
     send_command(device, &txMessage);
-    recv_response(device, &rxMessage);
+    if (recv_response(device, &rxMessage) < 0) {
+        return -1;
+    }
 
     if (rxMessage.info.ls_eeprom.le_data[0] == 0) {
         return -1;
@@ -411,7 +399,9 @@ int Playback::env_setenv(char *name, char *val)
     txMessage.info.ls_eeprom.le_subcmd = LSEEPROM_SETENV;
     snprintf((char *) txMessage.info.ls_eeprom.le_data, LSEEPROM_MAXDATA, "%s=%s",name,val);
     send_command(device, &txMessage);
-    recv_response(device, &rxMessage);
+    if (recv_response(device, &rxMessage) < 0) {
+        return -1;
+    }
     return 0;
 }
 
@@ -425,7 +415,9 @@ int Playback::env_listenv(char *val, int vallen)
     txMessage.info.ls_eeprom.le_subcmd = LSEEPROM_PRINTENV;
     txMessage.info.ls_eeprom.le_data[0] = 0;
     send_command(device, &txMessage);
-    recv_response(device, &rxMessage);
+    if (recv_response(device, &rxMessage) < 0) {
+        return -1;
+    }
 
     if (rxMessage.info.ls_eeprom.le_data[0] == 0) {
         return -1;
@@ -445,7 +437,9 @@ int Playback::env_eraseall(void)
     txMessage.info.ls_eeprom.le_subcmd = LSEEPROM_ERASEALL;
     txMessage.info.ls_eeprom.le_data[0] = 0;
     send_command(device, &txMessage);
-    recv_response(device, &rxMessage);
+    if (recv_response(device, &rxMessage) < 0) {
+        return -1;
+    }
 
     return 0;
 }
@@ -458,68 +452,654 @@ int Playback::reset_to_dfu(void)
     txMessage.ls_command = LSCMD_DFU;
     txMessage.ls_length = 0;
     send_command(device, &txMessage);
-    recv_response(device, &rxMessage);
+    if (recv_response(device, &rxMessage) < 0) {
+        return -1;
+    }
 
     return 0;
 }
 
 
-// Private
-void Playback::play_events(LSSchedule *sched, double start_cue, double end_cue)
+// private
+// The animate frame for an event, LSFRAME_ANIMATE_BYTES long.  Frames come
+// ready-made from compileFrames(), except for streaming schedules and
+// restored state, which are built in 'buf'.
+static const uint8_t *event_frame(LSSchedule *sched, const schedcmd_t *cmd, uint8_t *buf)
 {
-    int idx = 0;
-    int events = sched->size();
-    double start_time;
+    const uint8_t *frame = sched->frameFor(cmd);
 
-    start_time = current_time() + start_offset;
+    if (frame == NULL) {
+        unsigned int anim = cmd->animation;
+        lsmessage_t msg;
 
-    if (start_cue != 0.0) {
-        while (idx < events) {
-            schedcmd_t *cmd = sched->getAt(idx);
-            if (cmd->time < start_cue) {
-                idx++;
-            } else {
+        if (cmd->direction) anim |= 0x8000;
+        animate_message(&msg, cmd->stripmask, anim, cmd->speed, cmd->option, cmd->palette);
+        frame_message(buf, &msg);
+        frame = buf;
+    }
+    return frame;
+}
+
+// private
+void Playback::send_event(LSSchedule *sched, const schedcmd_t *cmd)
+{
+    if (cmd->comment.c_str()[0] == '\0') {
+        uint8_t built[LSFRAME_MAX];
+        const uint8_t *frame = event_frame(sched, cmd, built);
+
+        if (batching) {
+            txBatch[cmd->board].insert(txBatch[cmd->board].end(), frame, frame + LSFRAME_ANIMATE_BYTES);
+        } else {
+            write_frames(board_device(cmd->board), frame, LSFRAME_ANIMATE_BYTES);
+        }
+    }
+    lastsent = cmd->time;
+
+    log_event(sched, cmd);
+}
+
+// private
+// Send every event that is due at 'now', starting with 'cmd', and return
+// the first one that isn't.  The frames for each board go out in a single
+// write, so strips that change together really do.
+const schedcmd_t *Playback::send_due(LSSchedule *sched, const schedcmd_t *cmd, double now)
+{
+    lstick_t tick = secsToTicks(now);
+    uint64_t first = sendCount;
+
+    batching = true;
+    do {
+        if (!send_ahead(sched, cmd)) {
+            if (cmd->comment.c_str()[0] == '\0') {
+                note_send(cmd, LSFRAME_ANIMATE_BYTES, false);
+            }
+            send_event(sched, cmd);
+        }
+        cmd = sched->nextEvent();
+    } while (cmd && (secsToTicks(send_time(cmd, now)) <= tick));
+    flush_batch();
+    stamp_sends(first);
+
+    return cmd;
+}
+
+// private
+// Match a board's clock to ours: ask for its time a few times and keep the
+// answer that came back fastest, taking it to have been read halfway
+// through the round trip.
+bool Playback::sync_clock(int board)
+{
+    int fd = board_device(board);
+    double best = -1;
+    lsmessage_t msg;
+
+    for (int i = 0; i < PLAYAHEAD_ROUNDS; i++) {
+        double t0, t1;
+
+        msg.ls_command = LSCMD_CLOCK;
+        msg.ls_length = 0;
+
+        t0 = clock->now();
+        if ((send_command(fd, &msg) < 0) || (recv_response(fd, &msg) < 0)) {
+            return false;
+        }
+        t1 = clock->now();
+
+        if ((best < 0) || ((t1 - t0) < best)) {
+            best = t1 - t0;
+            boardClock[board] = msg.info.ls_clock.lc_time;
+            hostClock[board] = (t0 + t1) / 2;
+            aheadQueue[board] = msg.info.ls_clock.lc_queuesize;
+        }
+    }
+
+    return aheadQueue[board] > 0;
+}
+
+// private
+// Find the boards that can queue events and sync their clocks.  The rest
+// get their events when they're due, as before.
+void Playback::start_ahead(double now)
+{
+    aheadActive = false;
+
+    for (int b = 0; b < curscript->boardCount; b++) {
+        const char *name = curscript->boards[b].name.empty() ? "default" : curscript->boards[b].name.c_str();
+
+        ahead[b] = false;
+        aheadDue[b].clear();
+        if ((aheadWindow <= 0) || (board_device(b) <= 0)) {
+            continue;
+        }
+        if (boardProtocol[b] < PICOLIGHT_PROTOCOL_ANIMATE_AT) {
+            lsprintf("Board %s uses protocol %d, sending its events when they are due", name, boardProtocol[b]);
+            continue;
+        }
+        if (!sync_clock(b)) {
+            continue;
+        }
+        ahead[b] = true;
+        aheadActive = true;
+        lsprintf("Board %s queues up to %u events, sending them %.0f ms ahead", name, aheadQueue[b], aheadWindow * 1000.0);
+    }
+
+    lastSync = now;
+}
+
+// private
+// Throw away whatever the boards still have queued, for when we stop.
+void Playback::stop_ahead(void)
+{
+    lsmessage_t msg;
+
+    for (int b = 0; b < LSMAXBOARDS; b++) {
+        if (ahead[b]) {
+            msg.ls_command = LSCMD_FLUSH;
+            msg.ls_length = 0;
+            send_command(board_device(b), &msg);
+        }
+        ahead[b] = false;
+        aheadDue[b].clear();
+    }
+    aheadActive = false;
+}
+
+// private
+// The show time 'cmd' can go out: when it's due, or for a board that
+// queues events, up to aheadWindow before that as long as there's room.
+double Playback::send_time(const schedcmd_t *cmd, double now)
+{
+    double due = ticksToSecs(cmd->time);
+    std::deque<lstick_t> *q;
+    double at;
+
+    if (!aheadActive || !ahead[cmd->board]) {
+        return due;
+    }
+
+    // Forget the ones the board has already run.
+    q = &aheadDue[cmd->board];
+    while (!q->empty() && (q->front() <= secsToTicks(now))) {
+        q->pop_front();
+    }
+
+    at = due - aheadWindow;
+    if (q->size() >= aheadQueue[cmd->board]) {
+        at = std::max(at, ticksToSecs(q->front()));
+    }
+    return std::min(at, due);
+}
+
+// private
+// Queue 'cmd' on its board, stamped with the board time it should run.
+// Returns false if it has to be sent the ordinary way.
+bool Playback::send_ahead(LSSchedule *sched, const schedcmd_t *cmd)
+{
+    int b = cmd->board;
+    uint8_t built[LSFRAME_MAX];
+    const uint8_t *frame;
+    size_t used;
+    double host;
+    uint32_t when;
+
+    if (!aheadActive || !ahead[b] || (aheadDue[b].size() >= aheadQueue[b])) {
+        return false;
+    }
+
+    if (cmd->comment.c_str()[0] == '\0') {
+        frame = event_frame(sched, cmd, built);
+
+        host = ticksToSecs(cmd->time) + showBase;
+        when = boardClock[b] + (uint32_t) (int64_t) llround((host - hostClock[b]) * 1000000.0);
+
+        used = txBatch[b].size();
+        txBatch[b].resize(used + LSFRAME_ANIMATE_AT_BYTES);
+        frame_animate_at(&txBatch[b][used], frame, when);
+
+        aheadDue[b].push_back(cmd->time);
+        note_send(cmd, LSFRAME_ANIMATE_AT_BYTES, true);
+    }
+    lastsent = cmd->time;
+
+    log_event(sched, cmd);
+    return true;
+}
+
+// private
+void Playback::flush_batch(void)
+{
+    batching = false;
+    for (int b = 0; b < LSMAXBOARDS; b++) {
+        if (!txBatch[b].empty()) {
+            write_frames(board_device(b), txBatch[b].data(), txBatch[b].size());
+            txBatch[b].clear();
+        }
+    }
+}
+
+// private
+// Hand an event's log line to the logging thread.  Lines come ready-made
+// from formatLog(), except for streaming schedules and restored state.
+void Playback::log_event(LSSchedule *sched, const schedcmd_t *cmd)
+{
+    const char *line;
+
+    if (!logging) {
+        return;
+    }
+
+    line = sched->logLine(cmd);
+    eventLog.emplace(LSLOG_INFO, [&](char *buf, size_t len) {
+        if (line) {
+            memcpy(buf, line, strlen(line) + 1);
+        } else {
+            sched->formatSchedEntry(buf, len, cmd);
+        }
+    });
+}
+
+// private
+// The logging thread.  Prints lines until told to stop and the ring is empty.
+void Playback::log_run(void)
+{
+    for (;;) {
+        // Look before draining, so nothing logged before the stop is missed.
+        bool stopping = logStop;
+
+        if (eventLog.drain([](const logrec_t& rec) { lsprintf("%s", rec.text); }, LOGRING_SIZE) == 0) {
+            if (stopping) {
                 break;
             }
+            msleep(2);
+        }
+    }
+}
+
+void Playback::set_logging(bool enable)
+{
+    logging = enable;
+}
+
+void Playback::set_spin_window(double secs)
+{
+    spinWindow = (secs < 0) ? 0 : secs;
+}
+
+void Playback::set_send_ahead(double secs)
+{
+    aheadWindow = (secs < 0) ? 0 : secs;
+}
+
+// private
+// Note an event in the send ring.  stamp_sends() fills in when it went.
+void Playback::note_send(const schedcmd_t *cmd, int bytes, bool queued)
+{
+    playsend_t *s = &sends[sendCount & (PLAYLAT_RECORDS - 1)];
+
+    s->due = cmd->time;
+    s->line = cmd->line;
+    s->bytes = (uint16_t) bytes;
+    s->board = (uint8_t) cmd->board;
+    s->ahead = queued;
+    sendCount++;
+
+    if (queued) {
+        jitter.ahead++;
+    }
+}
+
+// private
+// The events from 'first' on have just been written, note the time.
+void Playback::stamp_sends(uint64_t first)
+{
+    int64_t sent;
+
+    if (first == sendCount) {
+        return;
+    }
+
+    sent = (int64_t) llround((clock->now() - showBase) * 1000000000.0);
+    for (uint64_t i = first; i < sendCount; i++) {
+        playsend_t *s = &sends[i & (PLAYLAT_RECORDS - 1)];
+        double late;
+
+        s->sent = sent;
+        if (s->ahead) {
+            continue;
+        }
+
+        late = (double) (sent - s->due * (1000000000 / LSTICKS_PER_SEC)) / 1000000000.0;
+        jitter.count++;
+        jitter.sum += late;
+        jitter.sumsq += late * late;
+        if (late > jitter.max) jitter.max = late;
+    }
+}
+
+// Upper edges of the latency histogram buckets, the last one is open.
+static const double latencyBuckets[PLAYLAT_BUCKETS-1] = {
+    0.00001, 0.00002, 0.00005, 0.0001, 0.0002, 0.0005,
+    0.001, 0.002, 0.005, 0.01, 0.02
+};
+
+// private
+// Work out the latency report from the send ring, after playing.
+void Playback::build_latency(void)
+{
+    uint64_t n = std::min<uint64_t>(sendCount, PLAYLAT_RECORDS);
+    std::map<int,double> byLine;
+    std::vector<double> late;
+
+    latency = playlatency_t();
+    late.reserve(n);
+
+    for (uint64_t i = sendCount - n; i < sendCount; i++) {
+        const playsend_t *s = &sends[i & (PLAYLAT_RECORDS - 1)];
+        double l = (double) (s->sent - s->due * (1000000000 / LSTICKS_PER_SEC)) / 1000000000.0;
+        int b = 0;
+
+        latency.bytes += s->bytes;
+        if (s->ahead) {
+            if ((latency.ahead == 0) || (-l < latency.minLead)) {
+                latency.minLead = -l;
+            }
+            latency.ahead++;
+            continue;
+        }
+
+        late.push_back(l);
+        while ((b < PLAYLAT_BUCKETS-1) && (l >= latencyBuckets[b])) {
+            b++;
+        }
+        latency.hist[b]++;
+
+        auto it = byLine.find(s->line);
+        if ((it == byLine.end()) || (l > it->second)) {
+            byLine[s->line] = l;
+        }
+    }
+
+    latency.events = (int) late.size();
+    if (late.empty()) {
+        return;
+    }
+
+    std::sort(late.begin(), late.end());
+    latency.p50 = late[(late.size() * 50) / 100];
+    latency.p90 = late[(late.size() * 90) / 100];
+    latency.p99 = late[(late.size() * 99) / 100];
+    latency.max = late.back();
+
+    latency.worst.assign(byLine.begin(), byLine.end());
+    std::sort(latency.worst.begin(), latency.worst.end(),
+              [](const std::pair<int,double>& a, const std::pair<int,double>& b) { return a.second > b.second; });
+    if (latency.worst.size() > PLAYLAT_WORST) {
+        latency.worst.resize(PLAYLAT_WORST);
+    }
+}
+
+#define LATBARWIDTH     40
+
+void Playback::print_latency(void)
+{
+    char bar[LATBARWIDTH+1];
+    int most = 0;
+
+    if (latency.events == 0) {
+        return;
+    }
+
+    lsprintf("Send latency over %d events: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, worst %.3f ms",
+             latency.events, latency.p50 * 1000.0, latency.p90 * 1000.0,
+             latency.p99 * 1000.0, latency.max * 1000.0);
+
+    for (int b = 0; b < PLAYLAT_BUCKETS; b++) {
+        most = std::max(most, latency.hist[b]);
+    }
+    for (int b = 0; b < PLAYLAT_BUCKETS; b++) {
+        int n = (latency.hist[b] * LATBARWIDTH + most - 1) / most;
+        memset(bar, '#', n);
+        bar[n] = 0;
+        if (b < PLAYLAT_BUCKETS-1) {
+            lsprintf("   < %6.2f ms | %-*s %d", latencyBuckets[b] * 1000.0, LATBARWIDTH, bar, latency.hist[b]);
+        } else {
+            lsprintf("  >= %6.2f ms | %-*s %d", latencyBuckets[b-1] * 1000.0, LATBARWIDTH, bar, latency.hist[b]);
+        }
+    }
+
+    lsprintf("Latest lines:");
+    for (const auto& w : latency.worst) {
+        lsprintf("  Line %d: %.3f ms", w.first, w.second * 1000.0);
+    }
+}
+
+std::string Playback::latency_json(void)
+{
+    char buf[256];
+    std::string json;
+
+    snprintf(buf, sizeof(buf),
+             "{\"events\": %d, \"ahead\": %d, \"bytes\": %llu, \"minLead\": %.6f,\n",
+             latency.events, latency.ahead, (unsigned long long) latency.bytes, latency.minLead);
+    json += buf;
+    snprintf(buf, sizeof(buf),
+             " \"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"max\": %.6f,\n",
+             latency.p50, latency.p90, latency.p99, latency.max);
+    json += buf;
+
+    json += " \"histogram\": [";
+    for (int b = 0; b < PLAYLAT_BUCKETS; b++) {
+        if (b < PLAYLAT_BUCKETS-1) {
+            snprintf(buf, sizeof(buf), "%s{\"below\": %.6f, \"events\": %d}",
+                     b ? ", " : "", latencyBuckets[b], latency.hist[b]);
+        } else {
+            snprintf(buf, sizeof(buf), ", {\"below\": null, \"events\": %d}", latency.hist[b]);
+        }
+        json += buf;
+    }
+    json += "],\n \"worst\": [";
+    for (size_t i = 0; i < latency.worst.size(); i++) {
+        snprintf(buf, sizeof(buf), "%s{\"line\": %d, \"late\": %.6f}",
+                 i ? ", " : "", latency.worst[i].first, latency.worst[i].second);
+        json += buf;
+    }
+    json += "]\n}\n";
+
+    return json;
+}
+
+// private
+void Playback::report_jitter(void)
+{
+    double mean, dev;
+
+    if (jitter.ahead && (latency.minLead >= 0)) {
+        lsprintf("Queued %d events on the boards ahead of time, the closest %.3f ms before it was due",
+                 jitter.ahead, latency.minLead * 1000.0);
+    } else if (jitter.ahead) {
+        lsprintf("Queued %d events on the boards ahead of time, some already late, by up to %.3f ms",
+                 jitter.ahead, -latency.minLead * 1000.0);
+    }
+    if (jitter.count == 0) {
+        return;
+    }
+
+    mean = jitter.sum / jitter.count;
+    dev = sqrt(std::max(0.0, jitter.sumsq / jitter.count - mean * mean));
+    lsprintf("Sent %d events late by %.3f ms on average, std dev %.3f ms, worst %.3f ms (event logging %s)",
+             jitter.count, mean * 1000.0, dev * 1000.0, jitter.max * 1000.0,
+             logging ? "on" : "off");
+    lsprintf("Half were sent within %.3f ms, 99%% within %.3f ms", latency.p50 * 1000.0, latency.p99 * 1000.0);
+    if (logDropped) {
+        lsprintf("%u log lines were dropped because the status window fell behind", logDropped);
+    }
+}
+
+// private
+// Pick up a schedule published by play_swap().  The new schedule carries on
+// from just after the last event that has really gone out.  Events queued
+// on the boards ahead of time came from the old schedule, and the edit may
+// have changed or removed them, so those are thrown away and sent again
+// from the new one.  This is only called from the playback thread, and
+// costs one atomic load when there is nothing to do.
+bool Playback::take_swap(double now)
+{
+    playswap_t *swap;
+    lstick_t resume = lastsent;
+    lsmessage_t msg;
+
+    if (pendingSwap.load(std::memory_order_relaxed) == NULL) {
+        return false;
+    }
+    swap = pendingSwap.exchange(NULL, std::memory_order_acquire);
+    if (swap == NULL) {
+        return false;
+    }
+
+    if (aheadActive) {
+        lstick_t tick = secsToTicks(now);
+
+        for (int b = 0; b < curscript->boardCount; b++) {
+            std::deque<lstick_t> *q = &aheadDue[b];
+
+            while (!q->empty() && (q->front() <= tick)) {
+                q->pop_front();
+            }
+            if (ahead[b] && !q->empty()) {
+                msg.ls_command = LSCMD_FLUSH;
+                msg.ls_length = 0;
+                send_command(board_device(b), &msg);
+                q->clear();
+            }
         }
+        resume = std::min(lastsent, tick);
+    }
+
+    curscript = swap->script;
+    cursched = swap->sched;
+    cursched->seek(resume + 1);
+    lastsent = resume;
+    adoptedEpoch.store(swap->epoch, std::memory_order_release);
+
+    lsprintf("Switched to the updated schedule");
+    return true;
+}
+
+void Playback::play_swap(playswap_t *swap)
+{
+    pendingSwap.store(swap, std::memory_order_release);
+}
+
+uint64_t Playback::play_epoch(void)
+{
+    return adoptedEpoch.load(std::memory_order_acquire);
+}
+
+bool Playback::play_running(void)
+{
+    return running;
+}
+
+// private
+// When starting from a cue, put the strips back into the state they would
+// have been in had we played from the start.
+void Playback::restore_state(LSSchedule *sched, double start_cue)
+{
+    std::vector<schedcmd_t> batch;
+
+    if (sched->stateAt(secsToTicks(start_cue), batch) == 0) {
+        return;
+    }
+
+    lsprintf("Restoring state at start cue");
+    batching = true;
+    for (auto& cmd : batch) {
+        send_event(sched, &cmd);
     }
+    flush_batch();
+}
+
+// Private
+void Playback::play_events(LSSchedule *sched, double start_cue, double end_cue)
+{
+    const schedcmd_t *cmd;
+    double start_time;
+
+    start_time = clock->now() + start_offset;
+    showBase = start_time - start_cue;
+
+    // Seek in script to cue point
+    restore_state(sched, start_cue);
+    sched->seek(secsToTicks(start_cue));
+    cmd = sched->nextEvent();
+    lastsent = secsToTicks(start_cue) - 1;
     
     last_offset = 0;
-    
-    while (!play_please_stop && (idx < events)) {
-        double now;
 
-        schedcmd_t *cmd = sched->getAt(idx);
+    start_ahead(start_cue);
+    
+    while (!play_please_stop && cmd) {
+        double now, at;
 
         // Figure out the difference between the time stamp
         // at the start and now.
-        now = current_time() - start_time + start_cue;
+        now = clock->now() - showBase;
 
         if ((now - last_offset) >= 0.1) {
             last_offset = now;
             if (time_callback) (*time_callback)(time_callback_arg, now);
         }
 
-        // If the current time is past the script command's time,
-        // do the command.
+        // Follow the boards' clocks as they drift.
+        if (aheadActive && ((now - lastSync) >= PLAYAHEAD_RESYNC)) {
+            for (int b = 0; b < curscript->boardCount; b++) {
+                if (ahead[b]) sync_clock(b);
+            }
+            lastSync = now;
+        }
 
-        if (now >= cmd->time) {
-            unsigned int anim;
+        if (take_swap(now)) {
+            sched = cursched;
+            cmd = sched->nextEvent();
+            if (!cmd) break;
+        }
 
-            anim = cmd->animation;
-            if (cmd->direction) anim |= 0x8000;
-            
-            sched->printSchedEntry(cmd);
-            if (cmd->comment.c_str()[0] == '\0') {
-                send_animate(device, cmd->stripmask, anim, cmd->speed, cmd->option, cmd->palette);
-            }
+        // If the current time is past the script command's time,
+        // do the command.
 
-            idx++;
+        if (secsToTicks(now) >= secsToTicks(send_time(cmd, now))) {
+            cmd = send_due(sched, cmd, now);
         }
 
         if ((end_cue != 0) && (now > (end_cue))) {
             break;
         }
+
+        // Sleep until just before the next event is due, then spin for the
+        // rest.  Wake up at least every PLAYSLEEP_MAX to update the time
+        // display and notice a stop or a live edit.  Events sent ahead
+        // don't need to leave on the dot, so there's no spinning for those.
+        if (cmd && (secsToTicks(now) < secsToTicks(at = send_time(cmd, now)))) {
+            double spin = (at < ticksToSecs(cmd->time)) ? 0 : spinWindow;
+            double until = std::min(at - spin, now + PLAYSLEEP_MAX);
+            if (until > now) {
+                clock->sleepUntil(until + showBase);
+            } else {
+                clock->spinUntil(at + showBase);
+            }
+        }
+    }
+
+    // Let the boards run what they have queued before the lights go off.
+    if (!cmd && !play_please_stop) {
+        lstick_t last = -1;
+
+        for (int b = 0; b < LSMAXBOARDS; b++) {
+            if (!aheadDue[b].empty()) last = std::max(last, aheadDue[b].back());
+        }
+        if (last >= 0) {
+            clock->sleepUntil(ticksToSecs(last) + showBase);
+        }
     }
 
 }
@@ -530,12 +1110,24 @@ void Playback::set_time_callback(void (*callback)(void *arg,double), void *arg)
     time_callback_arg = arg;
 }
 
-int Playback::player_callback(double now)
+void Playback::set_clock(PlaybackClock *c)
 {
+    userClock = c;
+}
+
+void Playback::set_audio_position(double secs)
+{
+    audioClock.setPosition(secs);
+}
+
+int Playback::player_callback(void)
+{
+    double now = clock->now();
+
     // If the current time is past the script command's time,
     // do the command.
 
-    if (musicpos == musicend) {
+    if (musiccmd == NULL) {
         // End of script, stop playing
         return 0;
     }
@@ -549,25 +1141,22 @@ int Playback::player_callback(double now)
         if (time_callback) (*time_callback)(time_callback_arg, now);
     }
 
-    schedcmd_t *cmd = (schedcmd_t *) cursched->getAt(musicpos);
+    if (take_swap(now)) {
+        musiccmd = cursched->nextEvent();
+        if (musiccmd == NULL) {
+            return 0;
+        }
+    }
+
+    const schedcmd_t *cmd = musiccmd;
 
     if ((curscript->lss_endcue != 0) && (now >= curscript->lss_endcue)) {
         // Past end cue, stop
         return 0;
     }
 
-    if (now >= cmd->time) {
-        unsigned int anim;
-
-        anim = cmd->animation;
-        if (cmd->direction) anim |= 0x8000;
-            
-        cursched->printSchedEntry(cmd);
-        if (cmd->comment.c_str()[0] == '\0') {
-            send_animate(device, cmd->stripmask, anim, cmd->speed, cmd->option, cmd->palette);
-        }
-
-        musicpos++;
+    if (secsToTicks(now) >= cmd->time) {
+        musiccmd = send_due(cursched, cmd, now);
     }
 
     // Keep going
@@ -578,25 +1167,21 @@ int Playback::player_callback(double now)
 // Private
 void Playback::play_music(LSSchedule *sched, double start_cue, double end_cue, std::string music)
 {
-    musicpos = 0;
-    musicend = sched->size();
-
     last_offset = 0;
-    // Seek in script to cue point
+    showBase = 0;
 
-    if (start_cue != 0.0) {
-        while (musicpos != musicend) {
-            schedcmd_t *cmd = sched->getAt(musicpos);
-            if (cmd->time > start_cue) break;
-            musicpos++;
-        }
+    // Seek in script to cue point
+    sched->seek(secsToTicks(start_cue));
+    musiccmd = sched->nextEvent();
+    lastsent = secsToTicks(start_cue) - 1;
 
-        // We started past the end of the script, bail.
-        if (musicpos == musicend) {
-            return;
-        }
+    // We started past the end of the script, bail.
+    if ((start_cue != 0.0) && (musiccmd == NULL)) {
+        return;
     }
 
+    restore_state(sched, start_cue);
+
     std::string musicPath = scriptDirectory + "/" + music;
     lsprintf("Playing music file: %s",musicPath.c_str());
     playMusicFile(musicPath.c_str(), this, start_cue);
@@ -607,7 +1192,7 @@ void Playback::play_music(LSSchedule *sched, double start_cue, double end_cue, s
 void Playback::play_idle(void)
 {
     int v;
-    uint32_t mask[MAXVSTRIPS/32];
+    ScriptMask mask;
 
     if (curscript->lss_idlestrips) {
         try {
@@ -619,7 +1204,12 @@ void Playback::play_idle(void)
 
     if (curscript->lss_idleanimation != "") {
         if (curscript->animTable.findSym(curscript->lss_idleanimation,v)) {
-            send_animate(device, mask, v, 500, 0, 0);
+            for (int b = 0; b < curscript->boardCount; b++) {
+                StripMask strips = boardMask(mask, b);
+                if (strips.any() || (b == 0)) {
+                    send_animate(board_device(b), strips, v, 500, 0, 0);
+                }
+            }
         } else {
             lsprinterr("Warning: idle animation '%s' is not valid",curscript->lss_idleanimation.c_str());
         }
@@ -628,22 +1218,67 @@ void Playback::play_idle(void)
 
 
 // private
-void Playback::all_off(void)
+// 'settle' waits 200ms after sending "OFF" to everyone.  Boards that
+// were just configured need it; ones that weren't touched don't.
+void Playback::all_off(bool settle)
 {
-    uint32_t mask[MAXVSTRIPS/32];
-
-    memset(mask,0,sizeof(mask));
-    mask[0] = 0x7FFFFFFF;
-    
-    // Send "OFF" to everyone, then wait 200ms.
     if (offAnim) {
-        send_animate(device,  mask, offAnim, 500, 0, 0);
-        msleep(200);
+        for (int b = 0; b < curscript->boardCount; b++) {
+            StripMask mask = StripMask::first(curscript->boards[b].virtualStripCount);
+            send_animate(board_device(b), mask, offAnim, 500, 0, 0);
+        }
+        if (settle) {
+            msleep(200);
+        }
     } 
 }
 
 // private
-int Playback::play_opentcpdevice(char *hostaddr)
+int Playback::board_device(int board)
+{
+    return (board == 0) ? device : boardDevices[board];
+}
+
+// private
+// Wait for the board on 'fd' to answer.  Returns 0, or one of the LSREAD_
+// codes if it doesn't answer in time or has gone away.
+int Playback::recv_response(int fd, lsmessage_t *msg)
+{
+    FrameReader *reader = &rx[0];
+    int res;
+
+    if (fd <= 0) {
+        return LSREAD_CLOSED;
+    }
+
+    for (int b = 1; b < LSMAXBOARDS; b++) {
+        if (boardDevices[b] == fd) {
+            reader = &rx[b];
+        }
+    }
+    if (reader->device() != fd) {
+        reader->reset(fd);
+    }
+
+    res = reader->next(msg, LSREAD_TIMEOUT_MS);
+    switch (res) {
+        case LSREAD_OK:
+            break;
+        case LSREAD_TIMEOUT:
+            lsprinterr("The PicoLight did not answer within %d ms", LSREAD_TIMEOUT_MS);
+            break;
+        case LSREAD_CLOSED:
+            lsprinterr("The PicoLight closed the connection");
+            break;
+        default:
+            lsprinterr("Read error from PicoLight: %s", strerror(errno));
+            break;
+    }
+    return res;
+}
+
+// private
+int Playback::play_opentcpdevice(char *hostaddr, int *device)
 {
     struct sockaddr_in sin;
     struct sockaddr *saddr;
@@ -694,24 +1329,24 @@ int Playback::play_opentcpdevice(char *hostaddr)
         exit(0); }
     ; 
 
-    device = fd;
+    *device = fd;
     
     return 0;
 
 }
 
 // private
-int Playback::play_openusbdevice(char *devname)
+int Playback::play_openusbdevice(char *devname, int *device)
 {
     if (devname != NULL) {
-        device = open(devname,O_RDWR);
+        *device = open(devname,O_RDWR);
 
-        if (device < 0) {
+        if (*device < 0) {
             lsprinterr("Error: Could not open Picolight device %s: %s\n",devname, strerror(errno));
             return -1;
         }
     } else {
-        device = -1;             // No device, just pretend.
+        *device = -1;            // No device, just pretend.
     }
 
     return 0;
@@ -721,7 +1356,7 @@ int Playback::play_opendevice(char *devname)
 {
     if ((inet_addr(devname) != INADDR_NONE) ||
         (strstr(devname,".lan") != NULL)) {
-        return play_opentcpdevice(devname);
+        return play_opentcpdevice(devname, &device);
     } else {
         if (!devname || devname[0] == '\0') {
             devname = findpicolight();
@@ -729,26 +1364,81 @@ int Playback::play_opendevice(char *devname)
                 return -1;
             }
         }
-        return play_openusbdevice(devname);
+        return play_openusbdevice(devname, &device);
     }
 
 }
 
+// private
+// Open the boards after the first, at the addresses given in the script.
+int Playback::play_openboards(void)
+{
+    int res = 0;
+
+    for (int b = 1; b < curscript->boardCount; b++) {
+        LSBoard *board = &curscript->boards[b];
+        char *addr = (char *) board->device.c_str();
+
+        if (boardDevices[b] > 0) {
+            continue;
+        }
+        if (board->device.empty()) {
+            lsprinterr("Board %s has no address, its strips will not light", board->name.c_str());
+            res = -1;
+            continue;
+        }
+        lsprintf("Connecting to board %s at %s", board->name.c_str(), addr);
+        if (((inet_addr(addr) != INADDR_NONE) || (strstr(addr,".lan") != NULL)) ?
+            play_opentcpdevice(addr, &boardDevices[b]) :
+            play_openusbdevice(addr, &boardDevices[b])) {
+            res = -1;
+        }
+    }
+
+    return res;
+}
+
 void Playback::play_closedevice(void)
 {
     if (device > 0) {
         close(device);
         device = -1;
     }
+    for (int b = 0; b < LSMAXBOARDS; b++) {
+        if (boardDevices[b] > 0) {
+            close(boardDevices[b]);
+        }
+        boardDevices[b] = -1;
+        rx[b].reset(-1);
+    }
 }
 
 void Playback::play_initdevice()
 {
+    lsversion_t v;
+    bool configured = false;
+    int res;
+
     check_version();
-    upload_config(curscript);
+    play_openboards();
+    for (int b = 1; b < curscript->boardCount; b++) {
+        boardProtocol[b] = board_version(board_device(b), &v);
+    }
+    for (int b = 0; b < curscript->boardCount; b++) {
+        if (board_device(b) <= 0) {
+            continue;
+        }
+        res = upload_config(b);
+        if (res < 0) {
+            lsprinterr("Could not configure board %s", curscript->boards[b].name.empty() ? "default" : curscript->boards[b].name.c_str());
+        }
+        if (res <= 0) {
+            configured = true;
+        }
+    }
     play_please_stop = false;
 
-    all_off();
+    all_off(configured);
     play_idle();
 }
 
@@ -767,6 +1457,10 @@ int Playback::play_start(int how)
         lsprinterr("ERROR: playback is running\n");
         return -1;
     }
+    // A live edit that came in after the last run stopped was never
+    // taken, and its schedule is gone.
+    pendingSwap.store(NULL, std::memory_order_relaxed);
+    running = true;
     playbackThread = std::thread(&Playback::run, this);
     return 0;
 }
@@ -784,18 +1478,39 @@ extern void (*g_playback_end_cb)(void);
 
 void Playback::run(void)
 {    
-    time(&epoch);
+    if (userClock) {
+        clock = userClock;
+    } else {
+        clock = play_with_music ? (PlaybackClock *) &audioClock : &monoClock;
+    }
+    clock->start();
+
+    memset(&jitter, 0, sizeof(jitter));
+    sendCount = 0;
+    logDropped = 0;
+    eventLog.reset();
+    logStop = false;
+    logThread = std::thread(&Playback::log_run, this);
     
     if (play_with_music == 0) {
         play_events(cursched, curscript->lss_startcue, curscript->lss_endcue);
     } else {
         play_music(cursched, curscript->lss_startcue, curscript->lss_endcue, curscript->lss_music);
     }
+    stop_ahead();
 
     msleep(500);
 
-    all_off();
+    all_off(true);
     play_idle();
+
+    logStop = true;
+    logThread.join();
+    logDropped = eventLog.takeDropped();
+    build_latency();
+    report_jitter();
+
+    running = false;
     lsprintf("Playback thread is finished");
     if (g_playback_end_cb) (*g_playback_end_cb)();
     
@@ -808,6 +1523,8 @@ void Playback::play_init(LSScript *script, LSSchedule *sched)
 
     curscript = script;
     cursched = sched;
+    cursched->formatLog();
+    cursched->compileFrames();
 
     // Send "OFF" to everyone, then wait 200ms.
     if (script->animTable.findSym(offStr,v)) {
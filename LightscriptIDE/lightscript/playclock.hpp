@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <atomic>
+
+//
+// Where playback gets the time from.  now() is seconds since start().
+// sleepUntil() waits until now() reaches 'when' or a little before, callers
+// always look at the time again.  spinUntil() is for the last moment before
+// an event, when accuracy matters more than CPU.
+//
+class PlaybackClock {
+public:
+    virtual ~PlaybackClock() {}
+
+    virtual void start(void) = 0;
+    virtual double now(void) = 0;
+    virtual void sleepUntil(double when) = 0;
+    virtual void spinUntil(double when) = 0;
+};
+
+//
+// The system's monotonic clock, in nanoseconds.  Unlike the wall clock it
+// never jumps when NTP or the user sets the time.
+//
+class MonotonicClock : public PlaybackClock {
+public:
+    void start(void) {
+        startNs = nanos();
+    }
+
+    double now(void) {
+        return (double) (nanos() - startNs) / 1000000000.0;
+    }
+
+    void sleepUntil(double when) {
+        struct timespec ts;
+
+#ifdef __APPLE__
+        // No clock_nanosleep on macOS, so sleep for the difference.  Oversleeping
+        // a little is fine, playback spins for the last bit anyway.
+        double delta = when - now();
+
+        if (delta <= 0) {
+            return;
+        }
+        ts.tv_sec = (time_t) delta;
+        ts.tv_nsec = (long) ((delta - ts.tv_sec) * 1000000000.0);
+        nanosleep(&ts, NULL);
+#else
+        int64_t ns = startNs + (int64_t) llround(when * 1000000000.0);
+
+        if (ns < 0) {
+            return;
+        }
+        ts.tv_sec = (time_t) (ns / 1000000000);
+        ts.tv_nsec = (long) (ns % 1000000000);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+#endif
+    }
+
+    void spinUntil(double when) {
+        while (now() < when) {
+        }
+    }
+
+private:
+    static int64_t nanos(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    int64_t startNs = 0;
+};
+
+//
+// Time is wherever the music is.  The audio player sets the position as
+// it plays, so the lights stay with the music even if it stalls or skips.
+//
+class AudioClock : public PlaybackClock {
+public:
+    void start(void) {
+        position = 0;
+    }
+
+    double now(void) {
+        return position.load(std::memory_order_relaxed);
+    }
+
+    void setPosition(double secs) {
+        position.store(secs, std::memory_order_relaxed);
+    }
+
+    // The music decides when time moves, so just wait a bit.
+    void sleepUntil(double when) {
+        struct timespec ts;
+        double delta = when - now();
+
+        if (delta <= 0) {
+            return;
+        }
+        if (delta > 0.01) {
+            delta = 0.01;
+        }
+        ts.tv_sec = 0;
+        ts.tv_nsec = (long) (delta * 1000000000.0);
+        nanosleep(&ts, NULL);
+    }
+
+    void spinUntil(double when) {
+        sleepUntil(when);
+    }
+
+private:
+    std::atomic<double> position{0};
+};
+
+//
+// A clock that only moves when told to, for testing.  Sleeping jumps
+// straight to the wake-up time, so a whole show runs instantly and the
+// same way every time.
+//
+class ManualClock : public PlaybackClock {
+public:
+    void start(void) {
+        current = 0;
+    }
+
+    double now(void) {
+        return current.load(std::memory_order_relaxed);
+    }
+
+    void sleepUntil(double when) {
+        if (when > now()) {
+            current.store(when, std::memory_order_relaxed);
+        }
+    }
+
+    void spinUntil(double when) {
+        sleepUntil(when);
+    }
+
+    void set(double secs) {
+        current.store(secs, std::memory_order_relaxed);
+    }
+
+    void advance(double secs) {
+        current.store(now() + secs, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> current{0};
+};
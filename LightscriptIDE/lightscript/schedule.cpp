@@ -2,7 +2,11 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <set>
+#include <thread>
 #include <assert.h>
+#include <stdarg.h>
+#include <errno.h>
 #include "schedule.hpp"
 #include "symtab.hpp"
 
@@ -17,6 +21,25 @@ LSSchedule::~LSSchedule()
 {
 }
 
+// Don't bother spinning up threads for tiny scripts.
+#define MINSLICE        32
+
+void LSSchedule::schedError(const char *fmt, ...)
+{
+    char textbuf[512];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(textbuf, sizeof(textbuf), fmt, args);
+    va_end(args);
+
+    if (errlog) {
+        errlog->push_back(textbuf);
+    } else {
+        lsprinterr("%s", textbuf);
+    }
+}
+
 #if 0
 static const char *lsctypes[] = {
     [LSC_UNKNOWN] = "UNKNOWN",
@@ -27,27 +50,31 @@ static const char *lsctypes[] = {
 };
 #endif
 
+// Strip number across all boards, see LSBoard.
 int LSSchedule::findStrip(std::string name)
 {
-    int i;
+    int b, i;
 
-    for (i = 0; i < script->virtualStripCount; i++) {
-        if (name == script->virtualStrips[i].name) {
-            return i;
+    for (b = 0; b < script->boardCount; b++) {
+        const LSBoard *board = &script->boards[b];
+        for (i = 0; i < board->virtualStripCount; i++) {
+            if (name == board->virtualStrips[i].name) {
+                return b*MAXVSTRIPS + i;
+            }
         }
     }
     return -1;
 }
 
 
-std::unique_ptr<schedcmd_t> LSSchedule::newSchedCmd(double baseTime, LSCommand_t *cmd)
+std::unique_ptr<schedcmd_t> LSSchedule::newSchedCmd(lstick_t baseTime, LSCommand_t *cmd)
 {
     // Create a new empty schedule record.
     auto scmd = std::make_unique<schedcmd_t>();
     // Fill in what we know.
 
     if (cmd) {
-        scmd->time = baseTime + cmd->lsc_from;
+        scmd->time = baseTime + secsToTicks(cmd->lsc_from);
         scmd->line = cmd->lsc_line;
         scmd->speed = cmd->opt_speed;
         scmd->brightness = cmd->opt_brightness;
@@ -69,7 +96,7 @@ void LSSchedule::stripVec1(LSCommand_t *c, stripvec_t *vec, idlist_t *list)
 
         if (script->stripListTable.findStripList(*i, sublist)) {
             if (nestLevel > 8) {
-                lsprinterr("[Line %d]: Strip lists nested too deep, are you putting a list in itself?", c->lsc_line);
+                schedError("[Line %d]: Strip lists nested too deep, are you putting a list in itself?", c->lsc_line);
             } else {
                 nestLevel++;
                 stripVec1(c, vec,sublist);
@@ -78,7 +105,7 @@ void LSSchedule::stripVec1(LSCommand_t *c, stripvec_t *vec, idlist_t *list)
         } else if ( (v = findStrip(*i)) >= 0) {
             vec->push_back(v);
         } else {
-            lsprinterr("[Line %d]: Could not find strip name: '%s'",c->lsc_line, i->c_str());
+            schedError("[Line %d]: Could not find strip name: '%s'",c->lsc_line, i->c_str());
             throw -1;
         }
     }
@@ -96,15 +123,14 @@ stripvec_t *LSSchedule::stripVec(LSCommand_t *c, idlist_t *list)
 
 
 
-void LSSchedule::stripMask(LSCommand_t *c, idlist_t *list,uint32_t *mask)
+void LSSchedule::stripMask(LSCommand_t *c, idlist_t *list, ScriptMask& mask)
 {
     int v;
     idlist_t::iterator i;
     idlist_t *sublist;
 
     if (nestLevel == 0) {
-        // Oh how terribly gross.
-        for (v = 0; v < MAXVSTRIPS/32; v++) mask[v] = 0;
+        mask.clear();
     }
 
     nestLevel++;
@@ -113,14 +139,14 @@ void LSSchedule::stripMask(LSCommand_t *c, idlist_t *list,uint32_t *mask)
 
         if (script->stripListTable.findStripList(*i, sublist)) {
             if (nestLevel > 8) {
-                lsprinterr("[Line %d]: Strip lists nested too deep, are you putting a list in itself?", c ? c->lsc_line : 0);
+                schedError("[Line %d]: Strip lists nested too deep, are you putting a list in itself?", c ? c->lsc_line : 0);
             } else {
                 stripMask(c, sublist, mask);
             }
         } else if ((v = findStrip(*i)) >= 0) {
-            mask[v/32] |= 1UL << (((uint32_t) v) & 31);
+            mask.set(v);
         } else {
-            lsprinterr("[Line %d]: Could not find strip name: '%s'",c ? c->lsc_line : 0, i->c_str());
+            schedError("[Line %d]: Could not find strip name: '%s'",c ? c->lsc_line : 0, i->c_str());
             throw -1;
         }
     }
@@ -137,7 +163,7 @@ void LSSchedule::setAnimation(LSCommand_t *cmd, schedcmd_t& scmd)
         scmd.animation = v;
     }
     else {
-        lsprinterr("[Line %d]: Could not find animation '%s', is it defined in your config file?",
+        schedError("[Line %d]: Could not find animation '%s', is it defined in your config file?",
                cmd->lsc_line,
                cmd->lsc_animation.c_str());
         // Throw exception.
@@ -151,7 +177,7 @@ void LSSchedule::setColor(LSCommand_t *cmd, schedcmd_t& scmd)
         if (script->colorTable.findSym(cmd->opt_colorIdent, v)) {
             scmd.palette = v;
         } else {
-            lsprinterr("[Line %d]: Color not found: '%s'",cmd->lsc_line,cmd->opt_colorIdent.c_str());
+            schedError("[Line %d]: Color not found: '%s'",cmd->lsc_line,cmd->opt_colorIdent.c_str());
             throw -1;
         }
     } else {
@@ -161,46 +187,91 @@ void LSSchedule::setColor(LSCommand_t *cmd, schedcmd_t& scmd)
 
 
 
-void LSSchedule::insert_do(double baseTime, LSCommand_t *c)
+// Divide, rounding to the nearest integer (halves away from zero).
+static lstick_t divRound(lstick_t num, lstick_t den)
+{
+    return (num >= 0) ? (num + den/2) / den : -((-num + den/2) / den);
+}
+
+//
+// Time of the k'th of 'count' events produced by a command.  Every offset is
+// converted to ticks before doing any arithmetic, so nothing accumulates.
+//
+lstick_t LSSchedule::eventTime(LSCommand_t *c, lstick_t baseTime, int k, int count)
+{
+    lstick_t from = baseTime + secsToTicks(c->lsc_from);
+
+    switch (c->lsc_type) {
+        case LSC_DO:
+            // Spaced evenly across the span, including the end stops.
+            if (count == 1) {
+                return from;
+            }
+            return from + divRound((secsToTicks(c->lsc_to) - secsToTicks(c->lsc_from)) * k, count-1);
+        case LSC_CASCADE:
+            return from + secsToTicks(c->opt_delay) * k;
+        default:
+            return from;
+    }
+}
+
+//
+// A 'do' works on all listed strips at once, which takes one event for each
+// board that has any of them.  A 'do' with no strips still makes one event.
+//
+void LSSchedule::boardMasks(LSCommand_t *c, std::vector<std::pair<int,StripMask>>& boards)
 {
+    ScriptMask all;
+
+    boards.clear();
+    if (c->lsc_strips.get()) {
+        nestLevel = 0;
+        stripMask(c,c->lsc_strips.get(),all);
+    }
+
+    for (int b = 0; b < script->boardCount; b++) {
+        StripMask m = boardMask(all, b);
+        if (m.any()) {
+            boards.push_back(std::make_pair(b, m));
+        }
+    }
+    if (boards.empty()) {
+        boards.push_back(std::make_pair(0, StripMask()));
+    }
+}
+
+void LSSchedule::insert_do(lstick_t baseTime, LSCommand_t *c)
+{
+    std::vector<std::pair<int,StripMask>> boards;
     int i;
-    double t;
-    double deltaTime;
     
     assert(c->lsc_count != 0);
 
-    // Compute total time that this command spans
-    deltaTime = c->lsc_to - c->lsc_from;
+    boardMasks(c, boards);
 
     // Generate commands in the span.  If it's only one command, then the time is zero,
     // otherwise it is spaced evenly across the span, including the end stops.
     for (i = 0; i < c->lsc_count; i++) {
-        if (c->lsc_count == 1) {
-            t = 0.0;
-        } else {
-            t = deltaTime * ((double) i / (double) (c->lsc_count-1));
-        }
+        for (auto& b : boards) {
 
-        // Create a template schedule command
-        auto scmd = newSchedCmd(baseTime + t, c);
+            // Create a template schedule command
+            auto scmd = newSchedCmd(baseTime, c);
+            scmd->time = eventTime(c, baseTime, i, c->lsc_count);
+            scmd->board = b.first;
+            scmd->stripmask = b.second;
 
-        // Fill in the strip mask, since this is a 'do' it works on all listed strips.
-        if (c->lsc_strips.get()) {
-            nestLevel = 0;
-            stripMask(c,c->lsc_strips.get(),scmd->stripmask);
-        }
+            // Set the animation
+            setAnimation(c, *scmd);
+            setColor(c, *scmd);
 
-        // Set the animation
-        setAnimation(c, *scmd);
-        setColor(c, *scmd);
-
-        // Place in the final schedule.
-        addSched(std::move(scmd));
+            // Place in the final schedule.
+            addSched(std::move(scmd));
+        }
     }
     
 }
 
-void LSSchedule::insert_cascade(double baseTime, LSCommand_t *c)
+void LSSchedule::insert_cascade(lstick_t baseTime, LSCommand_t *c)
 {
     stripvec_t *vec;
     stripvec_t::iterator s;
@@ -212,19 +283,16 @@ void LSSchedule::insert_cascade(double baseTime, LSCommand_t *c)
         auto scmd = newSchedCmd(baseTime, c);
         setAnimation(c, *scmd);
         setColor(c, *scmd);
-        for (int midx = 0; midx < MAXVSTRIPS/32; midx++) {
-            scmd->stripmask[midx] = 0;
-        }
-        uint32_t stripID = *s;
-        scmd->stripmask[stripID/32] = 1UL << (stripID & 31);
-        scmd->time += c->opt_delay * (double) i;
+        scmd->board = *s / MAXVSTRIPS;
+        scmd->stripmask = StripMask::bit(*s % MAXVSTRIPS);
+        scmd->time = eventTime(c, baseTime, i, (int) vec->size());
 
         // Place in the final schedule.
         addSched(std::move(scmd));
     }
 }
 
-void LSSchedule::insert_comment(double baseTime, LSCommand_t *c)
+void LSSchedule::insert_comment(lstick_t baseTime, LSCommand_t *c)
 {
     auto scmd = newSchedCmd(baseTime, c);
     scmd->comment = c->lsc_comment;
@@ -233,23 +301,78 @@ void LSSchedule::insert_comment(double baseTime, LSCommand_t *c)
     addSched(std::move(scmd));
 }
 
-void LSSchedule::insert_macro(double baseTime, LSCommand_t *c)
+//
+// Expand a macro body once, relative to time zero, and remember it.  Every
+// call of the macro then just adds a time-shifted copy.
+//
+const macrorun_t& LSSchedule::macroRun(LSCommand_t *c)
 {
     cmdlist_t *commands;
     idlist_t *args;
+    schedule_t saved;
 
-    if (script->macroTable.findMacro(c->lsc_macro, args, commands)) {
+    if (sharedMacros) {
+        auto found = sharedMacros->find(c->lsc_macro);
+        if (found != sharedMacros->end()) return found->second;
+    }
+
+    auto found = macroCache.find(c->lsc_macro);
+    if (found != macroCache.end()) {
+        return found->second;
+    }
+
+    if (!script->macroTable.findMacro(c->lsc_macro, args, commands)) {
+        schedError("[Line %d]: Macro not defined: '%s'",c->lsc_line,c->lsc_macro.c_str());
+        throw -1;
+    }
+
+    if (std::find(macroStack.begin(), macroStack.end(), c->lsc_macro) != macroStack.end()) {
+        schedError("[Line %d]: Macro '%s' calls itself",c->lsc_line,c->lsc_macro.c_str());
+        throw -1;
+    }
+
+    // Expand into an empty schedule, then put ours back.
+    macroStack.push_back(c->lsc_macro);
+    std::swap(saved, schedule);
+    try {
         for (auto& up : *commands) {
-            LSCommand_t* mc = up.get();
-            insert(c->lsc_from, mc);
+            insert(0, up.get());
         }
-    } else {
-        lsprinterr("[Line %d]: Macro not defined: '%s'",c->lsc_line,c->lsc_macro.c_str());
-        throw -1;
+    } catch (int e) {
+        std::swap(saved, schedule);
+        macroStack.pop_back();
+        throw;
+    }
+
+    std::stable_sort(schedule.begin(), schedule.end(),
+                     [](const std::unique_ptr<schedcmd_t>& a, const std::unique_ptr<schedcmd_t>& b) {
+                         return a->time < b->time;
+                     });
+
+    macrorun_t& run = macroCache[c->lsc_macro];
+    for (auto& e : schedule) {
+        run.push_back(*e);
     }
+
+    std::swap(saved, schedule);
+    macroStack.pop_back();
+
+    return run;
 }
 
-void LSSchedule::insert(double baseTime, LSCommand_t *c)
+void LSSchedule::insert_macro(lstick_t baseTime, LSCommand_t *c)
+{
+    const macrorun_t& run = macroRun(c);
+    lstick_t shift = baseTime + secsToTicks(c->lsc_from);
+
+    for (auto& e : run) {
+        auto scmd = std::make_unique<schedcmd_t>(e);
+        scmd->time += shift;
+        addSched(std::move(scmd));
+    }
+}
+
+void LSSchedule::insert(lstick_t baseTime, LSCommand_t *c)
 {
 
     switch (c->lsc_type) {
@@ -270,45 +393,822 @@ void LSSchedule::insert(double baseTime, LSCommand_t *c)
     }
 }
 
+//
+// Expand a contiguous range of script commands into our own schedule, leaving
+// it sorted by time.  Equal times stay in source order.
+//
+bool LSSchedule::generateSlice(size_t first, size_t last)
+{
+    size_t i;
+
+    try {
+        for (i = first; i < last; i++) {
+            LSCommand_t *cmd = script->lss_commands[i].get();
+            if (sharedWarnings) {
+                auto found = sharedWarnings->find(i);
+                if (found != sharedWarnings->end()) {
+                    for (auto& msg : found->second) {
+                        schedError("%s", msg.c_str());
+                    }
+                }
+            }
+            insert(0, cmd);
+        }
+    } catch (int e) {
+        return false;
+    }
+
+    std::stable_sort(schedule.begin(), schedule.end(),
+                     [](const std::unique_ptr<schedcmd_t>& a, const std::unique_ptr<schedcmd_t>& b) {
+                         return a->time < b->time;
+                     });
+    return true;
+}
+
+//
+// Merge sorted runs pairwise, one thread per pair, until one run is left.
+// Ties go to the earlier run, which holds the earlier source lines.
+//
+void LSSchedule::mergeRuns(std::vector<schedule_t>& runs)
+{
+    while (runs.size() > 1) {
+        std::vector<schedule_t> merged((runs.size() + 1) / 2);
+        std::vector<std::thread> threads;
+
+        for (size_t r = 0; r < runs.size(); r += 2) {
+            if (r + 1 == runs.size()) {
+                merged[r/2] = std::move(runs[r]);
+                continue;
+            }
+            threads.emplace_back([&runs, &merged, r]() {
+                schedule_t& a = runs[r];
+                schedule_t& b = runs[r+1];
+                schedule_t& out = merged[r/2];
+                out.reserve(a.size() + b.size());
+                std::merge(std::make_move_iterator(a.begin()), std::make_move_iterator(a.end()),
+                           std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()),
+                           std::back_inserter(out),
+                           [](const std::unique_ptr<schedcmd_t>& x, const std::unique_ptr<schedcmd_t>& y) {
+                               return x->time < y->time;
+                           });
+            });
+        }
+        for (auto& t : threads) t.join();
+        runs = std::move(merged);
+    }
+}
+
 bool LSSchedule::generate1(void)
 {
-    int i;
+    size_t ncmds = script->lss_commands.size();
+    size_t nslices = std::thread::hardware_concurrency();
+    bool result = true;
+
+    // Expanding a command only reads the script's tables, so slices of the
+    // command list can be expanded independently of each other.
+    if (nslices == 0) nslices = 1;
+    nslices = std::min(nslices, (ncmds + MINSLICE - 1) / MINSLICE);
 
-    for (i = 0; i < script->lss_commands.size(); i++) {
+    if (nslices <= 1) {
+        return generateSlice(0, ncmds);
+    }
+
+    std::vector<LSSchedule> workers(nslices);
+    std::vector<std::vector<std::string>> errors(nslices);
+    std::vector<char> ok(nslices);
+    std::vector<std::thread> threads;
+
+    // Expand the macros up front so the workers can share them.  Warnings
+    // from an expansion are kept with the call that caused it, and the
+    // worker with that call reports them, so they come out once and in
+    // order.  A macro that fails is left for its worker to expand again,
+    // and so is everything after it.
+    std::map<size_t, std::vector<std::string>> warnings;
+    std::set<std::string> expanded;
+    for (size_t i = 0; i < ncmds; i++) {
         LSCommand_t *cmd = script->lss_commands[i].get();
-        insert(0.0, cmd);
+        std::vector<std::string> msgs;
+
+        if (cmd->lsc_type != LSC_MACRO) continue;
+        if (expanded.count(cmd->lsc_macro)) continue;
+
+        errlog = &msgs;
+        try {
+            macroRun(cmd);
+        } catch (int e) {
+            // Forget the macros it called as well, their warnings went
+            // with this one.
+            for (auto it = macroCache.begin(); it != macroCache.end(); ) {
+                it = expanded.count(it->first) ? std::next(it) : macroCache.erase(it);
+            }
+            break;
+        }
+        for (auto& m : macroCache) {
+            expanded.insert(m.first);
+        }
+        if (!msgs.empty()) {
+            warnings[i] = std::move(msgs);
+        }
     }
-    
-    return true;
+    errlog = nullptr;
+
+    for (size_t w = 0; w < nslices; w++) {
+        size_t first = (ncmds * w) / nslices;
+        size_t last = (ncmds * (w+1)) / nslices;
+        workers[w].script = script;
+        workers[w].errlog = &errors[w];
+        workers[w].sharedMacros = &macroCache;
+        workers[w].sharedWarnings = &warnings;
+        threads.emplace_back([&workers, &ok, w, first, last]() {
+            ok[w] = workers[w].generateSlice(first, last);
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    // Report errors in source order, stopping where a serial pass would have.
+    for (size_t w = 0; w < nslices; w++) {
+        for (auto& msg : errors[w]) {
+            lsprinterr("%s", msg.c_str());
+        }
+        if (!ok[w]) {
+            result = false;
+            break;
+        }
+    }
+
+    if (result) {
+        std::vector<schedule_t> runs(nslices);
+        for (size_t w = 0; w < nslices; w++) {
+            runs[w] = std::move(workers[w].schedule);
+        }
+        mergeRuns(runs);
+        schedule = std::move(runs[0]);
+    }
+
+    return result;
 }
 
 bool LSSchedule::generate(const LSScript& theScript)
 {
-    bool result = true;
+    script = &theScript;
+    checkpoints.clear();
+    macroCache.clear();
+    logText.clear();
+    frameData.clear();
+
+    return generate1();
+}
+
+void LSSchedule::addSched(std::unique_ptr<schedcmd_t> scmd)
+{
+    // Sorted once the whole slice has been expanded, see generateSlice().
+    schedule.push_back(std::move(scmd));
+}
+
+//
+// Streaming mode.  Rather than expanding every event up front, keep a cursor
+// for each command that has started and pull events from whichever cursor is
+// earliest.  Top-level commands are only given a cursor once their first
+// event is due, so memory use follows the number of active commands rather
+// than the number of events.  A macro call walks the macro's cached
+// expansion, shifted to where it was called.
+//
+
+// Earliest time that a command can produce an event.
+lstick_t LSSchedule::firstTime(lstick_t baseTime, LSCommand_t *c)
+{
+    auto cur = newCursor(baseTime, c, std::vector<int>());
+
+    return (cur->count > 0) ? cur->time : LSTICK_NEVER;
+}
+
+// Which step of the command a cursor's idx'th event belongs to.  Steps
+// are produced in time order; the events within a step stay in order.
+int LSSchedule::cursorStep(schedcursor_t *cur, int idx)
+{
+    int step = idx / cur->per;
+
+    return cur->reverse ? (cur->count / cur->per - 1 - step) : step;
+}
+
+// Time of a cursor's idx'th event, in the order the command produces them.
+lstick_t LSSchedule::cursorTime(schedcursor_t *cur, int idx)
+{
+    int k = cursorStep(cur, idx);
+
+    if (cur->run) {
+        return (*cur->run)[k].time + cur->baseTime;
+    }
+    return eventTime(cur->cmd, cur->baseTime, k, cur->count / cur->per);
+}
+
+std::unique_ptr<schedcursor_t> LSSchedule::newCursor(lstick_t baseTime, LSCommand_t *c, std::vector<int> path)
+{
+    auto cur = std::make_unique<schedcursor_t>();
+
+    cur->cmd = c;
+    cur->baseTime = baseTime;
+    cur->path = std::move(path);
+    cur->index = 0;
+    cur->count = 0;
+    cur->per = 1;
+    cur->reverse = false;
+    cur->run = NULL;
+
+    switch (c->lsc_type) {
+        case LSC_DO:
+            assert(c->lsc_count != 0);
+            cur->tmpl = *newSchedCmd(baseTime, c);
+            boardMasks(c, cur->boards);
+            setAnimation(c, cur->tmpl);
+            setColor(c, cur->tmpl);
+            cur->per = static_cast<int>(cur->boards.size());
+            cur->count = c->lsc_count * cur->per;
+            cur->reverse = (c->lsc_to < c->lsc_from);
+            break;
+        case LSC_CASCADE:
+            {
+                stripvec_t *vec = stripVec(c,c->lsc_strips.get());
+                cur->strips = std::move(*vec);
+                delete vec;
+            }
+            cur->tmpl = *newSchedCmd(baseTime, c);
+            setAnimation(c, cur->tmpl);
+            setColor(c, cur->tmpl);
+            cur->count = static_cast<int>(cur->strips.size());
+            cur->reverse = (c->opt_delay < 0);
+            break;
+        case LSC_COMMENT:
+            cur->tmpl = *newSchedCmd(baseTime, c);
+            cur->tmpl.comment = c->lsc_comment;
+            cur->count = 1;
+            break;
+        case LSC_MACRO:
+            cur->run = &macroRun(c);
+            cur->baseTime = baseTime + secsToTicks(c->lsc_from);
+            cur->count = static_cast<int>(cur->run->size());
+            break;
+        default:
+            break;
+    }
+
+    if (cur->count > 0) {
+        cur->time = cursorTime(cur.get(), 0);
+    }
+
+    return cur;
+}
+
+// Heap order: earliest time first, then source order.
+static bool cursorAfter(const std::unique_ptr<schedcursor_t>& a, const std::unique_ptr<schedcursor_t>& b)
+{
+    if (a->time != b->time) return a->time > b->time;
+    return a->path > b->path;
+}
+
+void LSSchedule::pushCursor(std::unique_ptr<schedcursor_t> cur)
+{
+    if (cur->index >= cur->count) {
+        return;
+    }
+    heap.push_back(std::move(cur));
+    std::push_heap(heap.begin(), heap.end(), cursorAfter);
+}
+
+// Check every command the stream could produce, so errors show up now
+// and not in the middle of the show.
+void LSSchedule::validate(LSCommand_t *c)
+{
+    newCursor(0, c, std::vector<int>());
+}
+
+bool LSSchedule::generateStream(const LSScript& theScript)
+{
+    size_t i;
 
     script = &theScript;
+    streaming = true;
+    macroCache.clear();
 
     try {
-        generate1();
+        for (i = 0; i < script->lss_commands.size(); i++) {
+            validate(script->lss_commands[i].get());
+        }
     } catch (int e) {
-        result = false;
+        return false;
     }
 
-    return result;
+    rewind();
+    return true;
 }
 
-void LSSchedule::addSched(std::unique_ptr<schedcmd_t> scmd)
+void LSSchedule::rewind(void)
+{
+    nextIdx = 0;
+
+    if (!streaming) {
+        return;
+    }
+
+    heap.clear();
+    pending.clear();
+    for (size_t i = 0; i < script->lss_commands.size(); i++) {
+        pending.push_back(std::make_pair(firstTime(0, script->lss_commands[i].get()), (int) i));
+    }
+    std::sort(pending.begin(), pending.end());
+    nextPending = 0;
+}
+
+//
+// Index of the first event at or after time 't', or size() if there is none.
+// Only meaningful for a materialized schedule.
+//
+int LSSchedule::lowerBound(lstick_t t)
 {
-    schedule_t::iterator inshere;
+    auto it = std::lower_bound(schedule.begin(), schedule.end(), t,
+                               [](const std::unique_ptr<schedcmd_t>& e, lstick_t t) {
+                                   return e->time < t;
+                               });
+    return static_cast<int>(it - schedule.begin());
+}
 
-    // Perform an insertion sort into our schedule.
-    for (inshere = schedule.begin(); inshere < schedule.end(); inshere++) {
-        if (scmd->time < (*inshere)->time) {
+// Skip a cursor's events that come before 't'.  They are in time order, so
+// we can binary search for the first one to keep.
+void LSSchedule::seekCursor(std::unique_ptr<schedcursor_t> cur, lstick_t t)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = cur->count;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cursorTime(cur.get(), mid) < t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    cur->index = lo;
+    if (cur->index < cur->count) {
+        cur->time = cursorTime(cur.get(), cur->index);
+    }
+    pushCursor(std::move(cur));
+}
+
+//
+// Position the schedule so that nextEvent() returns the first event at or
+// after time 't'.  Events exactly at 't' are kept.
+//
+void LSSchedule::seek(lstick_t t)
+{
+    rewind();
+
+    if (!streaming) {
+        nextIdx = lowerBound(t);
+        return;
+    }
+
+    // Start every command that began before the seek point.
+    while ((nextPending < pending.size()) && (pending[nextPending].first < t)) {
+        int i = pending[nextPending].second;
+        seekCursor(newCursor(0, script->lss_commands[i].get(), std::vector<int>(1, i)), t);
+        nextPending++;
+    }
+}
+
+//
+// Return the next event in time order, or NULL at the end of the schedule.
+// In streaming mode the returned event is only valid until the next call.
+//
+const schedcmd_t *LSSchedule::nextEvent(void)
+{
+    if (!streaming) {
+        return (nextIdx < schedule.size()) ? schedule[nextIdx++].get() : NULL;
+    }
+
+    // Start any top-level commands that come before the earliest cursor.
+    while (nextPending < pending.size()) {
+        auto& p = pending[nextPending];
+        if (!heap.empty()) {
+            schedcursor_t *top = heap.front().get();
+            if ((p.first > top->time) ||
+                ((p.first == top->time) && (p.second >= top->path[0]))) {
+                break;
+            }
+        }
+        if (p.first == LSTICK_NEVER) {
+            // Nothing left that produces events.
+            nextPending = pending.size();
             break;
         }
+        pushCursor(newCursor(0, script->lss_commands[p.second].get(), std::vector<int>(1, p.second)));
+        nextPending++;
     }
-    schedule.insert(inshere, std::move(scmd));
-    
+
+    if (heap.empty()) {
+        return NULL;
+    }
+
+    std::pop_heap(heap.begin(), heap.end(), cursorAfter);
+    std::unique_ptr<schedcursor_t> cur = std::move(heap.back());
+    heap.pop_back();
+
+    int k = cursorStep(cur.get(), cur->index);
+
+    current = cur->run ? (*cur->run)[k] : cur->tmpl;
+    current.time = cur->time;
+    if (cur->cmd->lsc_type == LSC_CASCADE) {
+        current.board = cur->strips[k] / MAXVSTRIPS;
+        current.stripmask = StripMask::bit(cur->strips[k] % MAXVSTRIPS);
+    } else if (!cur->boards.empty()) {
+        auto& b = cur->boards[cur->index % cur->per];
+        current.board = b.first;
+        current.stripmask = b.second;
+    }
+
+    cur->index++;
+    if (cur->index < cur->count) {
+        cur->time = cursorTime(cur.get(), cur->index);
+        pushCursor(std::move(cur));
+    }
+
+    return &current;
+}
+
+//
+// Optimization pass: merge events that happen at the same time with the same
+// parameters into one event that covers all of their strips, saving a wire
+// message for each one merged.
+//
+// An event is only merged into an earlier one if none of the events between
+// them touch any of its strips.  That way each strip still receives exactly
+// the same sequence of commands at each instant, except for exact repeats of
+// a command it has just been sent, which do nothing.
+//
+static bool sameParams(const schedcmd_t *a, const schedcmd_t *b)
+{
+    return (a->board == b->board) &&
+        (a->animation == b->animation) &&
+        (a->speed == b->speed) &&
+        (a->option == b->option) &&
+        (a->palette == b->palette) &&
+        (a->direction == b->direction);
+}
+
+int LSSchedule::coalesce(void)
+{
+    size_t first, last, i, j;
+    int saved = 0;
+
+    // Only a materialized schedule can be rewritten.
+    if (streaming) {
+        return 0;
+    }
+
+    for (first = 0; first < schedule.size(); first = last) {
+        // Find the run of events at this time.
+        for (last = first + 1; last < schedule.size(); last++) {
+            if (schedule[last]->time != schedule[first]->time) break;
+        }
+
+        for (j = first + 1; j < last; j++) {
+            schedcmd_t *b = schedule[j].get();
+            StripMask passed;
+
+            if (!b->comment.empty()) continue;
+
+            // Walk back looking for an event to merge into, but don't move
+            // past anything else that touches our strips.
+            for (i = j; i-- > first; ) {
+                schedcmd_t *a = schedule[i].get();
+
+                if (!a || !a->comment.empty() || (a->board != b->board)) continue;
+
+                if (sameParams(a, b) && !b->stripmask.intersects(passed)) {
+                    a->stripmask |= b->stripmask;
+                    schedule[j].reset();
+                    saved++;
+                    break;
+                }
+
+                passed |= a->stripmask;
+                if (b->stripmask.intersects(passed)) break;
+            }
+        }
+    }
+
+    schedule.erase(std::remove(schedule.begin(), schedule.end(), nullptr), schedule.end());
+    checkpoints.clear();
+    logText.clear();
+    frameData.clear();
+
+    return saved;
+}
+
+//
+// Optimization pass: when several events hit the same strip at the same time,
+// only the last one matters, the others are replaced as soon as they arrive.
+// Take the strip out of the earlier events, and drop events that end up with
+// no strips at all.  Returns the number of events dropped.  If 'apply' is
+// false the schedule is left alone, and it only says what it would drop.
+//
+int LSSchedule::dropDead(bool verbose, bool apply)
+{
+    size_t first, last, j;
+    int dropped = 0;
+    int owner[LSMAXSTRIPS];
+
+    if (streaming) {
+        return 0;
+    }
+
+    for (first = 0; first < schedule.size(); first = last) {
+        StripMask owned[LSMAXBOARDS];
+        std::vector<std::pair<size_t,int>> dead;
+
+        for (last = first + 1; last < schedule.size(); last++) {
+            if (schedule[last]->time != schedule[first]->time) break;
+        }
+
+        // Latest event wins, so walk the run backwards.
+        for (j = last; j-- > first; ) {
+            schedcmd_t *e = schedule[j].get();
+
+            if (!e->comment.empty()) continue;
+
+            StripMask& mine = owned[e->board];
+            StripMask live = e->stripmask.andNot(mine);
+            int over = (e->stripmask & mine).lowest();
+            int *who = &owner[e->board * MAXVSTRIPS];
+            int line = e->line;
+
+            live.forEach([&](int v) { who[v] = line; });
+            mine |= e->stripmask;
+
+            if (e->stripmask.any() && live.none()) {
+                dead.push_back(std::make_pair(j, who[over]));
+            } else if (apply) {
+                e->stripmask = live;
+            }
+        }
+
+        // Report in schedule order, then drop them.
+        for (auto d = dead.rbegin(); d != dead.rend(); d++) {
+            if (verbose) {
+                lsprintf("%s event, overridden by line %d:", apply ? "Dropped" : "Dead", d->second);
+                printSchedEntry(schedule[d->first].get());
+            }
+            if (apply) {
+                schedule[d->first].reset();
+            }
+            dropped++;
+        }
+    }
+
+    if (!apply) {
+        return dropped;
+    }
+
+    schedule.erase(std::remove(schedule.begin(), schedule.end(), nullptr), schedule.end());
+    checkpoints.clear();
+    logText.clear();
+    frameData.clear();
+
+    return dropped;
+}
+
+//
+// Record which event each strip last saw, every LSCHECKPOINT_SECS.
+//
+void LSSchedule::buildCheckpoints(void)
+{
+    schedckpt_t ckpt;
+    lstick_t interval = secsToTicks(LSCHECKPOINT_SECS);
+    size_t i;
+
+    checkpoints.clear();
+
+    ckpt.time = 0;
+    ckpt.pos = 0;
+    for (i = 0; i < LSMAXSTRIPS; i++) ckpt.last[i] = -1;
+
+    for (i = 0; i < schedule.size(); i++) {
+        schedcmd_t *e = schedule[i].get();
+
+        while (e->time >= ckpt.time) {
+            ckpt.pos = i;
+            checkpoints.push_back(ckpt);
+            ckpt.time += interval;
+        }
+
+        if (!e->comment.empty()) continue;
+
+        int *last = &ckpt.last[e->board * MAXVSTRIPS];
+        e->stripmask.forEach([&](int v) { last[v] = (int) i; });
+    }
+
+    if (checkpoints.empty()) {
+        ckpt.pos = schedule.size();
+        checkpoints.push_back(ckpt);
+    }
+}
+
+//
+// Work out the smallest set of events that puts every strip back into the
+// state it would be in at time 't', as if the show had been running from
+// the start.  Strips that end up doing the same thing share one event.
+// Returns the number of events placed in 'batch'.
+//
+int LSSchedule::stateAt(lstick_t t, std::vector<schedcmd_t>& batch)
+{
+    int last[LSMAXSTRIPS];
+    size_t i, end;
+    int v;
+
+    batch.clear();
+
+    if (streaming || (t <= 0)) {
+        return 0;
+    }
+
+    if (checkpoints.empty()) {
+        buildCheckpoints();
+    }
+
+    // Start from the closest checkpoint, then play forward to 't'.
+    size_t k = (size_t) (t / secsToTicks(LSCHECKPOINT_SECS));
+    if (k >= checkpoints.size()) k = checkpoints.size() - 1;
+    const schedckpt_t& ckpt = checkpoints[k];
+
+    memcpy(last, ckpt.last, sizeof(last));
+    end = lowerBound(t);
+
+    for (i = ckpt.pos; i < end; i++) {
+        schedcmd_t *e = schedule[i].get();
+        if (!e->comment.empty()) continue;
+        int *board = &last[e->board * MAXVSTRIPS];
+        e->stripmask.forEach([&](int v) { board[v] = (int) i; });
+    }
+
+    for (v = 0; v < script->boardCount * MAXVSTRIPS; v++) {
+        schedcmd_t *e;
+        size_t b;
+
+        if (last[v] < 0) continue;
+        e = schedule[last[v]].get();
+
+        for (b = 0; b < batch.size(); b++) {
+            if (sameParams(&batch[b], e)) break;
+        }
+        if (b == batch.size()) {
+            batch.push_back(*e);
+            batch[b].time = t;
+            batch[b].log = -1;
+            batch[b].frame = -1;
+            batch[b].stripmask.clear();
+        }
+        batch[b].stripmask.set(v % MAXVSTRIPS);
+    }
+
+    return static_cast<int>(batch.size());
+}
+
+//
+// Compare against a newer version of the schedule, counting events that were
+// added, removed or left alone.  Source lines are ignored since editing the
+// script moves them around.
+//
+static bool sameEvent(const schedcmd_t *a, const schedcmd_t *b)
+{
+    return (a->time == b->time) &&
+        (a->comment == b->comment) &&
+        sameParams(a, b) &&
+        (a->stripmask == b->stripmask);
+}
+
+bool LSSchedule::diff(const LSSchedule& newer, int& added, int& removed, int& unchanged)
+{
+    const schedule_t& a = schedule;
+    const schedule_t& b = newer.schedule;
+    size_t i = 0, j = 0;
+
+    added = removed = unchanged = 0;
+
+    if (streaming || newer.streaming) {
+        return false;
+    }
+
+    while ((i < a.size()) || (j < b.size())) {
+        if ((j == b.size()) || ((i < a.size()) && (a[i]->time < b[j]->time))) {
+            removed++;
+            i++;
+        } else if ((i == a.size()) || (b[j]->time < a[i]->time)) {
+            added++;
+            j++;
+        } else {
+            // Same time: match up the events at this time in any order.
+            size_t ia, ja, ib, jb;
+            lstick_t t = a[i]->time;
+
+            for (ia = i; (ia < a.size()) && (a[ia]->time == t); ia++) ;
+            for (ja = j; (ja < b.size()) && (b[ja]->time == t); ja++) ;
+
+            std::vector<bool> used(ja - j, false);
+            for (ib = i; ib < ia; ib++) {
+                for (jb = j; jb < ja; jb++) {
+                    if (!used[jb-j] && sameEvent(a[ib].get(), b[jb].get())) break;
+                }
+                if (jb < ja) {
+                    used[jb-j] = true;
+                    unchanged++;
+                } else {
+                    removed++;
+                }
+            }
+            added += static_cast<int>(std::count(used.begin(), used.end(), false));
+
+            i = ia;
+            j = ja;
+        }
+    }
+
+    return true;
+}
+
+int LSSchedule::analyzeLoad(double linkRate, schedload_t& report)
+{
+    std::vector<lstick_t> times;
+    std::vector<int> lines;
+    std::vector<double> delays;
+    double wire = (double) LSLOAD_FRAME_BYTES / linkRate;
+    double busy[LSMAXBOARDS] = {0};
+
+    report.linkRate = linkRate;
+    report.window = LSLOAD_WINDOW_SECS;
+    report.events = 0;
+    report.bytes = 0;
+    report.peakEvents = 0;
+    report.peakBytes = 0;
+    report.maxDelay = 0;
+    report.flagged = 0;
+    report.windows.clear();
+
+    // Send every event through a model of the link.  Comments are
+    // never sent.  Each board has a link of its own.
+    forEachEvent([&](const schedcmd_t *scmd) {
+        if (!scmd->comment.empty()) return;
+
+        double t = ticksToSecs(scmd->time);
+        double start = std::max(t, busy[scmd->board]);
+
+        busy[scmd->board] = start + wire;
+        times.push_back(scmd->time);
+        lines.push_back(scmd->line);
+        delays.push_back(start - t);
+    });
+
+    report.events = static_cast<int>(times.size());
+    report.bytes = report.events * (int) LSLOAD_FRAME_BYTES;
+    if (times.empty()) {
+        return 0;
+    }
+
+    lstick_t width = secsToTicks(LSLOAD_WINDOW_SECS);
+    lstick_t step = width / 2;
+    lstick_t t0 = (times.front() / step) * step;
+    size_t first = 0;
+
+    for (lstick_t ws = t0; ws <= times.back(); ws += step) {
+        schedwindow_t w;
+        size_t i;
+
+        while ((first < times.size()) && (times[first] < ws)) first++;
+
+        w.start = ws;
+        w.events = 0;
+        w.maxDelay = 0;
+        for (i = first; (i < times.size()) && (times[i] < ws + width); i++) {
+            w.events++;
+            w.maxDelay = std::max(w.maxDelay, delays[i]);
+            if (delays[i] > LSLOAD_LATE_SECS) {
+                w.lines.push_back(lines[i]);
+            }
+        }
+        w.bytes = w.events * (int) LSLOAD_FRAME_BYTES;
+
+        std::sort(w.lines.begin(), w.lines.end());
+        w.lines.erase(std::unique(w.lines.begin(), w.lines.end()), w.lines.end());
+
+        report.peakEvents = std::max(report.peakEvents, w.events / LSLOAD_WINDOW_SECS);
+        report.peakBytes = std::max(report.peakBytes, w.bytes / LSLOAD_WINDOW_SECS);
+        report.maxDelay = std::max(report.maxDelay, w.maxDelay);
+        if (!w.lines.empty()) report.flagged++;
+
+        report.windows.push_back(std::move(w));
+    }
+
+    return report.flagged;
 }
 
 static void fmttime(char *dest, size_t len, double t)
@@ -318,30 +1218,45 @@ static void fmttime(char *dest, size_t len, double t)
     snprintf(dest,len,"%2u:%05.02f",
             minutes,seconds);
 }
-#define MAXSTRIPS 31
-static char *maskstr(char *str,uint32_t m)
+// Show at least this many strips so short configs still line up
+#define MINSHOWSTRIPS 31
+static const char *maskChars = "123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+static char *maskstr(char *str, const StripMask& m, int nstrips)
 {
+    int len = (int) strlen(maskChars);
     int i;
 
-    for (i = 0; i<MAXSTRIPS; i++) {
-        str[(MAXSTRIPS-1)-i] = ((1 << i) & m) ? "123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[i] : '.';
+    if (nstrips < MINSHOWSTRIPS) nstrips = MINSHOWSTRIPS;
+    if (nstrips > MAXVSTRIPS) nstrips = MAXVSTRIPS;
+
+    for (i = 0; i < nstrips; i++) {
+        str[(nstrips-1)-i] = m.test(i) ? ((i < len) ? maskChars[i] : '#') : '.';
     }
-    str[MAXSTRIPS] = 0;
+    str[nstrips] = 0;
     return str;
 }
 
 void LSSchedule::printSchedEntry(const schedcmd_t *scmd)
 {
-    char tmpstr[MAXSTRIPS+1];
+    char line[LSLOGLINE_MAX];
+
+    formatSchedEntry(line, sizeof(line), scmd);
+    lsprintf("%s", line);
+}
+
+int LSSchedule::formatSchedEntry(char *buf, size_t len, const schedcmd_t *scmd)
+{
+    char tmpstr[MAXVSTRIPS+1];
     char animstr[32];
     char colorstr[32];
     char timestr[16];
+    char boardstr[36];
     std::string name;
 
-    fmttime(timestr,sizeof(tmpstr),scmd->time);
+    fmttime(timestr,sizeof(timestr),ticksToSecs(scmd->time));
 
     if (!scmd->comment.empty()) {
-        lsprintf("Time %8s | Line %3d | %s",timestr,scmd->line,scmd->comment.c_str());
+        return snprintf(buf,len,"Time %8s | Line %3d | %s",timestr,scmd->line,scmd->comment.c_str());
     } else {
         if (script->animTable.findVal(scmd->animation, name)) {
             snprintf(animstr,sizeof(animstr),"%s",name.c_str());
@@ -359,25 +1274,218 @@ void LSSchedule::printSchedEntry(const schedcmd_t *scmd)
             }
         }
 
-        lsprintf("Time %8s | Line %3d | %-15.15s %c | speed %5u | option %5u | %-14.14s %c | strips %s",timestr,scmd->line, animstr,
+        const LSBoard *board = &script->boards[scmd->board];
+
+        // Only name the board when there is more than one.
+        if (script->boardCount > 1) {
+            snprintf(boardstr,sizeof(boardstr),"%s:",board->name.empty() ? "default" : board->name.c_str());
+        } else {
+            boardstr[0] = '\0';
+        }
+
+        return snprintf(buf,len,"Time %8s | Line %3d | %-15.15s %c | speed %5u | option %5u | %-14.14s %c | strips %s%s",timestr,scmd->line, animstr,
                scmd->direction ? 'R' : 'F',
                scmd->speed, scmd->option,
                colorstr, (scmd->palette & COLORFLG ? ' ' : 'P'),
-               maskstr(tmpstr,(uint64_t)(scmd->stripmask[0])));  // XXX FIX ME XXX
+               boardstr, maskstr(tmpstr, scmd->stripmask, board->virtualStripCount));
     }
 }
 
+//
+// Format every event's log line ahead of time, so playback only has to
+// copy it.  This is redone after anything that rewrites the schedule.
+// A streaming schedule has nowhere to keep them; its lines are formatted
+// as they are sent.
+//
+void LSSchedule::formatLog(void)
+{
+    char line[LSLOGLINE_MAX];
 
-void LSSchedule::printSched(void)
+    logText.clear();
+    if (streaming) {
+        return;
+    }
+
+    for (auto& e : schedule) {
+        int n = formatSchedEntry(line, sizeof(line), e.get());
+        if (n >= (int) sizeof(line)) n = sizeof(line) - 1;
+
+        e->log = static_cast<int>(logText.size());
+        logText.insert(logText.end(), line, line + n + 1);
+    }
+}
+
+// The line formatLog() made for an event, or NULL if there isn't one.
+const char *LSSchedule::logLine(const schedcmd_t *scmd)
 {
-    schedule_t::iterator inshere;
+    if (logText.empty() || (scmd->log < 0)) {
+        return NULL;
+    }
+    return &logText[scmd->log];
+}
+
+//
+// Build the wire frame for every event ahead of time, so playback only has
+// to write it out.  Like formatLog(), this is redone after anything that
+// rewrites the schedule, and a streaming schedule builds its frames as
+// they are sent.
+//
+void LSSchedule::compileFrames(void)
+{
+    lsmessage_t msg;
+
+    frameData.clear();
+    if (streaming) {
+        return;
+    }
+
+    frameData.reserve(schedule.size() * LSFRAME_ANIMATE_BYTES);
+    for (auto& e : schedule) {
+        unsigned int anim = e->animation;
+
+        if (e->comment.c_str()[0] != '\0') {
+            e->frame = -1;
+            continue;
+        }
+        if (e->direction) anim |= 0x8000;
+
+        animate_message(&msg, e->stripmask, anim, e->speed, e->option, e->palette);
+        e->frame = static_cast<int>(frameData.size());
+        frameData.resize(frameData.size() + LSFRAME_ANIMATE_BYTES);
+        frame_message(&frameData[e->frame], &msg);
+    }
+}
+
+// The frame compileFrames() made for an event, LSFRAME_ANIMATE_BYTES long,
+// or NULL if there isn't one.
+const uint8_t *LSSchedule::frameFor(const schedcmd_t *scmd)
+{
+    if (frameData.empty() || (scmd->frame < 0)) {
+        return NULL;
+    }
+    return &frameData[scmd->frame];
+}
+
+// Write the compiled frames to a file, exactly as they'd go to the board.
+bool LSSchedule::dumpFrames(const char *filename)
+{
+    FILE *f;
+    bool ok;
+
+    if (frameData.empty()) {
+        compileFrames();
+    }
+
+    if ((f = fopen(filename, "wb")) == NULL) {
+        lsprinterr("Could not create %s : %s", filename, strerror(errno));
+        return false;
+    }
+    ok = (fwrite(frameData.data(), 1, frameData.size(), f) == frameData.size());
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        lsprinterr("Could not write %s", filename);
+    }
+    return ok;
+}
 
-    for (inshere = schedule.begin(); inshere < schedule.end(); inshere++) {
-        schedcmd_t *scmd = inshere->get();
 
+void LSSchedule::printSched(void)
+{
+    forEachEvent([&](const schedcmd_t *scmd) {
         printSchedEntry(scmd);
+    });
+}
+
+#define LOADBUCKETS     11              // 10% each, the last is over 100%
+#define LOADBARWIDTH    50
+#define LOADMAXLINES    8
+void LSSchedule::printLoad(const schedload_t& report)
+{
+    int buckets[LOADBUCKETS] = {0};
+    int most = 0;
+    char timestr[16];
+    char bar[LOADBARWIDTH+1];
+    std::string linestr;
+
+    lsprintf("Link load: %d events, %d bytes, link %.0f bytes/sec, %.0f byte frames",
+             report.events, report.bytes, report.linkRate, (double) LSLOAD_FRAME_BYTES);
+    lsprintf("Peak %.0f events/sec, %.0f bytes/sec (%.0f%% of link), worst delay %.1f ms",
+             report.peakEvents, report.peakBytes,
+             100.0 * report.peakBytes / report.linkRate, report.maxDelay * 1000.0);
+
+    for (const schedwindow_t& w : report.windows) {
+        int b = (int) ((10.0 * w.bytes) / (report.linkRate * report.window));
+        b = std::min(b, LOADBUCKETS-1);
+        buckets[b]++;
+        most = std::max(most, buckets[b]);
+    }
+
+    lsprintf("Windows by link utilization (%.1f sec wide):", report.window);
+    for (int b = 0; b < LOADBUCKETS; b++) {
+        int n = most ? (buckets[b] * LOADBARWIDTH + most - 1) / most : 0;
+        memset(bar, '#', n);
+        bar[n] = 0;
+        if (b < LOADBUCKETS-1) {
+            lsprintf("  %3d-%3d%% | %-*s %d", b*10, b*10+10, LOADBARWIDTH, bar, buckets[b]);
+        } else {
+            lsprintf("     >100%% | %-*s %d", LOADBARWIDTH, bar, buckets[b]);
+        }
+    }
+
+    if (report.flagged == 0) {
+        lsprintf("No events are delayed more than %.0f ms", LSLOAD_LATE_SECS * 1000.0);
+        return;
+    }
+
+    lsprintf("%d windows have events delayed more than %.0f ms:", report.flagged, LSLOAD_LATE_SECS * 1000.0);
+    for (const schedwindow_t& w : report.windows) {
+        if (w.lines.empty()) continue;
+
+        linestr.clear();
+        for (size_t i = 0; (i < w.lines.size()) && (i < LOADMAXLINES); i++) {
+            linestr += (i ? ", " : "") + std::to_string(w.lines[i]);
+        }
+        if (w.lines.size() > LOADMAXLINES) linestr += ", ...";
+
+        fmttime(timestr, sizeof(timestr), ticksToSecs(w.start));
+        lsprintf("  Time %8s | %4.0f events/sec | %6.0f bytes/sec | delay %6.1f ms | lines %s",
+                 timestr, w.events / report.window, w.bytes / report.window,
+                 w.maxDelay * 1000.0, linestr.c_str());
+    }
+}
+
+std::string LSSchedule::loadJson(const schedload_t& report)
+{
+    char buf[256];
+    std::string json;
+
+    snprintf(buf, sizeof(buf),
+             "{\"linkRate\": %.0f, \"frameBytes\": %d, \"window\": %.3f, \"lateThreshold\": %.3f,\n",
+             report.linkRate, (int) LSLOAD_FRAME_BYTES, report.window, LSLOAD_LATE_SECS);
+    json += buf;
+    snprintf(buf, sizeof(buf),
+             " \"events\": %d, \"bytes\": %d, \"peakEventsPerSec\": %.1f, \"peakBytesPerSec\": %.1f, \"maxDelay\": %.6f, \"flagged\": %d,\n",
+             report.events, report.bytes, report.peakEvents, report.peakBytes, report.maxDelay, report.flagged);
+    json += buf;
+    json += " \"windows\": [";
+
+    for (size_t i = 0; i < report.windows.size(); i++) {
+        const schedwindow_t& w = report.windows[i];
+
+        snprintf(buf, sizeof(buf),
+                 "%s\n  {\"start\": %.6f, \"events\": %d, \"bytes\": %d, \"eventsPerSec\": %.1f, \"bytesPerSec\": %.1f, \"maxDelay\": %.6f, \"late\": %s, \"lines\": [",
+                 i ? "," : "", ticksToSecs(w.start), w.events, w.bytes,
+                 w.events / report.window, w.bytes / report.window,
+                 w.maxDelay, w.lines.empty() ? "false" : "true");
+        json += buf;
+        for (size_t j = 0; j < w.lines.size(); j++) {
+            json += (j ? ", " : "") + std::to_string(w.lines[j]);
+        }
+        json += "]}";
     }
+    json += "\n ]\n}\n";
 
+    return json;
 }
 
 int LSSchedule::size(void)
@@ -392,6 +1500,15 @@ schedcmd_t *LSSchedule::getAt(int idx)
 
 void LSSchedule::reset()
 {
+    streaming = false;
+    nextIdx = 0;
+    heap.clear();
+    pending.clear();
+    nextPending = 0;
+    checkpoints.clear();
+    macroCache.clear();
+    logText.clear();
+    frameData.clear();
     schedule.clear();         // vector<unique_ptr<...>> — frees entries
     schedule.shrink_to_fit(); // optional
 }
@@ -1,16 +1,49 @@
 
 
 #include "parser.hpp"
+#include "stripmask.hpp"
+#include "wireframe.hpp"
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
-
+#include <math.h>
+
+//
+// Schedule times are kept in integer ticks so that equal times really are
+// equal and sorting is integer compares.  Script times are converted once,
+// rounded to the nearest tick (halves away from zero).
+//
+typedef int64_t lstick_t;
+#define LSTICKS_PER_SEC 1000000
+#define LSTICK_NEVER    INT64_MAX
+
+static inline lstick_t secsToTicks(double secs)
+{
+    return (lstick_t) llround(secs * (double) LSTICKS_PER_SEC);
+}
+
+static inline double ticksToSecs(lstick_t ticks)
+{
+    return (double) ticks / (double) LSTICKS_PER_SEC;
+}
+
+typedef StripMaskT<MAXVSTRIPS> StripMask;          // Strips on one board
+typedef StripMaskT<LSMAXSTRIPS> ScriptMask;        // Strips on every board
+
+static inline StripMask boardMask(const ScriptMask& m, int board)
+{
+    return m.slice<MAXVSTRIPS>(board * MAXVSTRIPS);
+}
 
 typedef struct schedcmd_s {
-    double time;
+    lstick_t time;
     std::string comment;
     int line;
-    uint32_t stripmask[MAXVSTRIPS/32];
+    int board;                          // Which board the event goes to
+    int log = -1;                       // Offset of its line from formatLog(), or -1
+    int frame = -1;                     // Offset of its wire frame from compileFrames(), or -1
+    StripMask stripmask;
     int animation;
     int speed;
     int brightness;
@@ -23,41 +56,195 @@ typedef struct schedcmd_s {
 
 typedef std::vector<std::unique_ptr<schedcmd_t>> schedule_t;
 
+#define LSLOGLINE_MAX   512             // Longest log line for an event, as for lsprintf
+
+// A macro body expanded relative to time zero, sorted by time.
+typedef std::vector<schedcmd_t> macrorun_t;
+typedef std::map<std::string, macrorun_t> macrocache_t;
+
+//
+// When streaming, each command that is producing events has a cursor.
+// Cursors always produce their events in time order.
+//
+typedef struct schedcursor_s {
+    lstick_t time;                      // Time of the next event
+    std::vector<int> path;              // Position in source order, breaks ties
+    LSCommand_t *cmd;
+    lstick_t baseTime;
+    int index;                          // Next event to produce
+    int count;                          // Total events from this command
+    int per;                            // Events at each step, one per board for 'do'
+    bool reverse;                       // Produce steps last to first
+    stripvec_t strips;                  // Cascade order
+    std::vector<std::pair<int,StripMask>> boards;   // 'do': board and strips of each event in a step
+    const macrorun_t *run;              // Macro call: the expanded body
+    schedcmd_t tmpl;                    // Fields common to all events
+} schedcursor_t;
+
+typedef std::vector<std::unique_ptr<schedcursor_t>> cursorheap_t;
+
+//
+// Checkpoints of what each strip is doing, so we can restore the look of
+// the show when starting in the middle.  'last' is the index of the event
+// that most recently touched each strip before 'time', or -1.
+//
+#define LSCHECKPOINT_SECS       10
+
+typedef struct schedckpt_s {
+    lstick_t time;
+    size_t pos;                         // First event at or after 'time'
+    int last[LSMAXSTRIPS];
+} schedckpt_t;
+
+//
+// Link load analysis.  Every event goes out as one animate frame, and the
+// link sends frames one after another.  An event is late when the frames
+// ahead of it take longer on the wire than the time since they were due.
+//
+#define LSLOAD_FRAME_BYTES      LSFRAME_ANIMATE_BYTES
+#define LSLOAD_WINDOW_SECS      1.0     // Sliding window width; it advances by half
+#define LSLOAD_LATE_SECS        0.010   // Delay that flags a window
+#define LSLOAD_DEFAULT_RATE     100000  // Bytes per second
+
+typedef struct schedwindow_s {
+    lstick_t start;
+    int events;
+    int bytes;
+    double maxDelay;                    // Worst time an event waited for the link
+    std::vector<int> lines;             // Source lines of the late events
+} schedwindow_t;
+
+typedef struct schedload_s {
+    double linkRate;                    // Bytes per second
+    double window;
+    int events;
+    int bytes;
+    double peakEvents;                  // Per second, over any window
+    double peakBytes;
+    double maxDelay;
+    int flagged;                        // Windows with a late event
+    std::vector<schedwindow_t> windows;
+} schedload_t;
+
 class LSSchedule {
 public:
     LSSchedule();
     ~LSSchedule();
 public:
-    void stripMask(LSCommand_t *c, idlist_t *list, uint32_t *mask);
+    void stripMask(LSCommand_t *c, idlist_t *list, ScriptMask& mask);
 
 private:
     int nestLevel;
 
+    // When generating in parallel, each worker collects its error messages
+    // here so they can be printed in source order once all workers are done.
+    std::vector<std::string> *errlog = nullptr;
+    void schedError(const char *fmt, ...);
+
 private:
-    void insert(double baseTime, LSCommand_t *c);
-    void insert_do(double baseTime, LSCommand_t *c);
-    void insert_comment(double baseTime, LSCommand_t *c);
-    void insert_cascade(double baseTime, LSCommand_t *c);
-    void insert_macro(double baseTime, LSCommand_t *c);
-    std::unique_ptr<schedcmd_t> newSchedCmd(double baseTime, LSCommand_t *cmd);
+    void insert(lstick_t baseTime, LSCommand_t *c);
+    void insert_do(lstick_t baseTime, LSCommand_t *c);
+    void insert_comment(lstick_t baseTime, LSCommand_t *c);
+    void insert_cascade(lstick_t baseTime, LSCommand_t *c);
+    void insert_macro(lstick_t baseTime, LSCommand_t *c);
+
+    // Expanded macros, each done once.  Workers share the cache built
+    // by the parent before they start.
+    macrocache_t macroCache;
+    const macrocache_t *sharedMacros = nullptr;
+    const std::map<size_t, std::vector<std::string>> *sharedWarnings = nullptr;   // Expansion warnings, by command
+    std::vector<std::string> macroStack;
+    const macrorun_t& macroRun(LSCommand_t *c);
+    std::unique_ptr<schedcmd_t> newSchedCmd(lstick_t baseTime, LSCommand_t *cmd);
     void setAnimation(LSCommand_t *cmd, schedcmd_t& scmd);
     void setColor(LSCommand_t *cmd, schedcmd_t& scmd);
     void stripVec1(LSCommand_t *c, std::vector<int> *vec, idlist_t *list);
     std::vector<int> *stripVec(LSCommand_t *c, idlist_t *list);
+    void boardMasks(LSCommand_t *c, std::vector<std::pair<int,StripMask>>& boards);
 
     void addSched(std::unique_ptr<schedcmd_t> scmd);
 
+    // Call f(scmd) for every event in time order.  It has a cursor of its
+    // own, so the playback thread can go on using rewind()/nextEvent().
+    // A stream is walked by a second schedule that shares the macros
+    // expanded when it was validated; anything it would complain about
+    // has been reported already.
+    template <typename F>
+    void forEachEvent(F f) {
+        if (!streaming) {
+            for (auto& e : schedule) f(e.get());
+            return;
+        }
+
+        LSSchedule walker;
+        std::vector<std::string> quiet;
+        const schedcmd_t *scmd;
+
+        walker.script = script;
+        walker.streaming = true;
+        walker.sharedMacros = &macroCache;
+        walker.errlog = &quiet;
+        walker.rewind();
+        while ((scmd = walker.nextEvent()) != NULL) f(scmd);
+    }
+
+    // Streaming mode
+    bool streaming = false;
+    size_t nextIdx = 0;                 // Next event, when not streaming
+    cursorheap_t heap;                  // Cursors that have started
+    std::vector<std::pair<lstick_t,int>> pending;   // Top-level commands not yet started
+    size_t nextPending = 0;
+    schedcmd_t current;
+    lstick_t firstTime(lstick_t baseTime, LSCommand_t *c);
+    void validate(LSCommand_t *c);
+    std::unique_ptr<schedcursor_t> newCursor(lstick_t baseTime, LSCommand_t *c, std::vector<int> path);
+    void pushCursor(std::unique_ptr<schedcursor_t> cur);
+    void seekCursor(std::unique_ptr<schedcursor_t> cur, lstick_t t);
+    lstick_t eventTime(LSCommand_t *c, lstick_t baseTime, int k, int count);
+    lstick_t cursorTime(schedcursor_t *cur, int idx);
+    int cursorStep(schedcursor_t *cur, int idx);
+
     int findStrip(std::string name);
 
     schedule_t schedule;
     const LSScript* script = nullptr;
 
     bool generate1(void);
+    bool generateSlice(size_t first, size_t last);
+
+    std::vector<schedckpt_t> checkpoints;
+    void buildCheckpoints(void);
+
+    // Every event's log line, one after another, see formatLog().
+    std::vector<char> logText;
+
+    // Every event's animate frame, one after another, see compileFrames().
+    std::vector<uint8_t> frameData;
+    static void mergeRuns(std::vector<schedule_t>& runs);
 
 public:
     bool generate(const LSScript& theScript);
+    bool generateStream(const LSScript& theScript);
+    bool isStreaming(void) { return streaming; }
+    void rewind(void);
+    int lowerBound(lstick_t t);
+    void seek(lstick_t t);
+    const schedcmd_t *nextEvent(void);
+    int coalesce(void);
+    int stateAt(lstick_t t, std::vector<schedcmd_t>& batch);
+    bool diff(const LSSchedule& newer, int& added, int& removed, int& unchanged);
+    int analyzeLoad(double linkRate, schedload_t& report);
+    void printLoad(const schedload_t& report);
+    std::string loadJson(const schedload_t& report);
+    int dropDead(bool verbose, bool apply);
     void printSched(void);
     void printSchedEntry(const schedcmd_t *scmd);
+    int formatSchedEntry(char *buf, size_t len, const schedcmd_t *scmd);
+    void formatLog(void);
+    const char *logLine(const schedcmd_t *scmd);
+    void compileFrames(void);
+    const uint8_t *frameFor(const schedcmd_t *scmd);
+    bool dumpFrames(const char *filename);
     int size(void);
     schedcmd_t *getAt(int i);
     void reset(void);
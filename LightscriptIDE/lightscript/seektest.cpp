@@ -0,0 +1,240 @@
+
+//
+// Checks LSSchedule::lowerBound() and seek() where several events share
+// a time.  Seeking to 't' must give exactly the events at or after 't', in
+// the order a full pass gives them, whether the schedule was generated up
+// front or is streamed.  The script below has runs of events at the same
+// time from plain commands, cascades with no delay and macro calls, and
+// from cascades and a macro already under way meeting at a later time.
+// Every event time is tried, as well as a tick either side, the gaps
+// between runs and the end.
+//
+// Exits 0 if every check passes.
+//
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "tokenstream.hpp"
+#include "lsinternal.h"
+#include "parser.hpp"
+#include "schedule.hpp"
+
+extern "C" {
+#include "ls_lexer.h"
+lstoken_t yylval;
+}
+
+extern "C" {
+int lsprintf(const char * str, ...)
+{
+    va_list args;
+    va_start(args, str);
+    vprintf(str, args);
+    va_end(args);
+    printf("\n");
+    return 0;
+}
+int lsprinterr(const char * str, ...)
+{
+    va_list args;
+    va_start(args, str);
+    vprintf(str, args);
+    va_end(args);
+    printf("\n");
+    return 0;
+}
+};
+
+static const char *panelText =
+    "physical {\n"
+    "    pstrip P1 channel A1 type GRB count 100;\n"
+    "    pstrip P2 channel A2 type GRB count 100;\n"
+    "};\n"
+    "virtual {\n"
+    "    vstrip s1 { substrip P1 start 0 count 20; };\n"
+    "    vstrip s2 { substrip P1 start 20 count 20; };\n"
+    "    vstrip s3 { substrip P1 start 40 count 20; };\n"
+    "    vstrip s4 { substrip P2 start 0 count 20; };\n"
+    "    vstrip s5 { substrip P2 start 20 count 20; };\n"
+    "};\n"
+    "defanim OFF = 0;\n"
+    "defanim RAINBOW = 1;\n"
+    "defanim FLASH = 2;\n"
+    "defstrip all = [s1, s2, s3, s4, s5];\n"
+    "defstrip left = [s1, s2];\n";
+
+static const char *scriptText =
+    "defmacro burst { at 0.0 do FLASH on s1; at 0.0 do FLASH on s2; at 0.5 do RAINBOW on left; };\n"
+    "at 1.0 do RAINBOW on s1;\n"
+    "at 1.0 do RAINBOW on s2;\n"
+    "at 1.0 do FLASH on s3;\n"
+    "at 2.0 cascade FLASH on all delay 0.0;\n"
+    "at 2.0 do OFF on s4;\n"
+    "at 2.0 macro burst;\n"
+    "at 2.5 do RAINBOW on s5;\n"
+    "at 3.0 cascade RAINBOW on all delay 0.25;\n"
+    "at 4.0 macro burst;\n"
+    "at 4.0 do OFF on all;\n"
+    "at 4.5 do FLASH on s3;\n"
+    "at 5.0 cascade RAINBOW on all delay 0.25;\n"
+    "at 5.0 macro burst;\n"
+    "at 5.25 cascade FLASH on left delay 0.25;\n";
+
+// What we compare: everything that ends up on the wire, plus the source line.
+typedef struct seekevent_s {
+    lstick_t time;
+    int line;
+    int board;
+    int animation;
+    StripMask strips;
+
+    bool operator==(const seekevent_s& o) const {
+        return (time == o.time) && (line == o.line) && (board == o.board) &&
+            (animation == o.animation) && (strips == o.strips);
+    }
+} seekevent_t;
+
+static int checks = 0;
+static int failed = 0;
+
+static void tokenize(LSTokenStream& ts, const char *name, const char *text)
+{
+    YY_BUFFER_STATE buf = yy_scan_bytes(text, (int) strlen(text));
+    lstoktype_t t;
+
+    yylineno = 1;
+    while ((t = (lstoktype_t) yylex())) {
+        LSToken tok = LSToken(t, name, yylineno, &yylval);
+        ts.add(tok);
+    }
+    yy_delete_buffer(buf);
+}
+
+static std::vector<seekevent_t> take(LSSchedule& sched)
+{
+    std::vector<seekevent_t> events;
+    const schedcmd_t *scmd;
+
+    while ((scmd = sched.nextEvent()) != NULL) {
+        events.push_back({scmd->time, scmd->line, scmd->board, scmd->animation, scmd->stripmask});
+    }
+    return events;
+}
+
+static void check(bool ok, const char *fmt, ...)
+{
+    va_list args;
+
+    checks++;
+    if (ok) {
+        return;
+    }
+    failed++;
+    printf("FAIL: ");
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+}
+
+static void try_seeks(const char *mode, LSSchedule& sched, const std::vector<lstick_t>& points)
+{
+    std::vector<seekevent_t> all;
+
+    sched.rewind();
+    all = take(sched);
+    printf("=== %s: %d events\n", mode, (int) all.size());
+
+    for (lstick_t t : points) {
+        std::vector<seekevent_t> want;
+        std::vector<seekevent_t> got;
+
+        for (auto& e : all) {
+            if (e.time >= t) want.push_back(e);
+        }
+
+        sched.seek(t);
+        got = take(sched);
+        check(got == want, "%s: seek %.6f gave %d events, expected %d",
+              mode, ticksToSecs(t), (int) got.size(), (int) want.size());
+
+        if (!sched.isStreaming()) {
+            int lb = sched.lowerBound(t);
+            check(lb == (int) (all.size() - want.size()), "%s: lowerBound %.6f is %d, expected %d",
+                  mode, ticksToSecs(t), lb, (int) (all.size() - want.size()));
+        }
+
+        printf("    seek %9.6f: %2d events%s\n", ticksToSecs(t), (int) got.size(),
+               (!got.empty() && (got[0].time == t)) ? ", first exactly at the cue" : "");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    LSTokenStream ts;
+    LSParser parser;
+    LSScript script;
+    LSSchedule eager;
+    LSSchedule stream;
+    std::set<lstick_t> times;
+    std::vector<lstick_t> points;
+    std::vector<seekevent_t> a, b;
+
+    tokenize(ts, "panel", panelText);
+    tokenize(ts, "script", scriptText);
+    parser.init(&ts, &script);
+    try {
+        parser.parseTopLevel();
+    } catch (...) {
+        printf("Could not parse the test script\n");
+        return 1;
+    }
+
+    if (!eager.generate(script) || !stream.generateStream(script)) {
+        printf("Could not generate the test schedule\n");
+        return 1;
+    }
+
+    // Every event time, a tick either side, half way to the next, and
+    // the ends.
+    eager.rewind();
+    for (auto& e : take(eager)) {
+        times.insert(e.time);
+    }
+    points.push_back(0);
+    for (auto it = times.begin(); it != times.end(); ++it) {
+        auto next = std::next(it);
+        points.push_back(*it - 1);
+        points.push_back(*it);
+        points.push_back(*it + 1);
+        if (next != times.end()) {
+            points.push_back((*it + *next) / 2);
+        }
+    }
+    points.push_back(*times.rbegin() + LSTICKS_PER_SEC);
+
+    try_seeks("eager", eager, points);
+    try_seeks("streaming", stream, points);
+
+    // Both ways must give the same events in the same order.  Ties go in
+    // source order, and that decides which event wins on a strip.
+    eager.rewind();
+    stream.rewind();
+    a = take(eager);
+    b = take(stream);
+    check(a.size() == b.size(), "eager has %d events, streaming %d", (int) a.size(), (int) b.size());
+    for (size_t i = 0; i < std::min(a.size(), b.size()); i++) {
+        check(a[i] == b[i], "event %d differs: eager line %d at %.6f, streaming line %d at %.6f",
+              (int) i, a[i].line, ticksToSecs(a[i].time), b[i].line, ticksToSecs(b[i].time));
+    }
+
+    printf("%d checks, %d failed\n", checks, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+
+//
+// Measures how fast messages go out to a board, and how many write()
+// calls each one takes, using send_command() from wireframe.hpp, which is
+// what playback uses.  Run it against picoemu on the same machine:
+//
+//     picoemu &
+//     sendbench [-a addr] [-n count] [-s]
+//
+// It sends 'count' animate messages as fast as it can, then asks for the
+// board's status; the answer means the board has read everything before
+// it.  -s writes the sync bytes and the message separately, the way they
+// used to go, for comparison.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "wireframe.hpp"
+#include "framereader.hpp"
+
+#define BENCH_PORT      4242
+#define BENCH_COUNT     200000
+
+//
+// Count the write() calls to the board by standing in front of the real
+// one.  send_command() is compiled into this program, so its calls come
+// here.
+//
+static int benchDevice = -1;
+static uint64_t benchWrites = 0;
+static uint64_t benchBytes = 0;
+
+extern "C" ssize_t write(int fd, const void *buf, size_t len)
+{
+    static ssize_t (*realWrite)(int, const void *, size_t) = NULL;
+
+    if (realWrite == NULL) {
+        realWrite = (ssize_t (*)(int, const void *, size_t)) dlsym(RTLD_NEXT, "write");
+    }
+    if (fd == benchDevice) {
+        benchWrites++;
+        benchBytes += len;
+    }
+    return realWrite(fd, buf, len);
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0;
+}
+
+// The old way: sync bytes, then the message.
+static int send_split(int device, lsmessage_t *msg)
+{
+    static const uint8_t sync[LSFRAME_SYNCSIZE] = {0x02, 0xAA};
+
+    write_frames(device, sync, sizeof(sync));
+    return write_frames(device, (const uint8_t *) msg, LSMSG_HDRSIZE + msg->ls_length);
+}
+
+static int open_board(const char *addr)
+{
+    struct sockaddr_in sin;
+    int flags = 1;
+    int fd;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(BENCH_PORT);
+    if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+        fprintf(stderr,"Not an IP address: %s\n", addr);
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+        fprintf(stderr,"Could not connect to %s:%d : %s, is picoemu running?\n", addr, BENCH_PORT, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // Same as playback.
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+    return fd;
+}
+
+// Send a command that gets an answer and wait for it.
+static bool ask(int fd, FrameReader& rx, uint8_t cmd, lsmessage_t *answer)
+{
+    lsmessage_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.ls_command = cmd;
+    msg.ls_length = 0;
+    send_command(fd, &msg);
+
+    if (rx.next(answer, LSREAD_TIMEOUT_MS) != LSREAD_OK) {
+        fprintf(stderr,"No answer from the board\n");
+        return false;
+    }
+    if (answer->ls_command != cmd) {
+        fprintf(stderr,"The board answered command %02X with %02X\n", cmd, answer->ls_command);
+        return false;
+    }
+    return true;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: sendbench [-a addr] [-n count] [-s]\n\n");
+    fprintf(stderr,"    -a addr             Address of the board, default 127.0.0.1\n");
+    fprintf(stderr,"    -n count            Messages to send, default %d\n", BENCH_COUNT);
+    fprintf(stderr,"    -s                  Write the sync bytes separately, as before\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *addr = "127.0.0.1";
+    int count = BENCH_COUNT;
+    bool split = false;
+    FrameReader rx;
+    lsmessage_t msg;
+    lsmessage_t answer;
+    double start, elapsed;
+    int ch;
+    int fd;
+
+    while ((ch = getopt(argc, argv, "a:n:s")) != -1) {
+        switch (ch) {
+            case 'a':
+                addr = optarg;
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 's':
+                split = true;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (count <= 0) {
+        usage();
+    }
+
+    fd = open_board(addr);
+    if (fd < 0) {
+        exit(1);
+    }
+    rx.reset(fd);
+    if (!ask(fd, rx, LSCMD_VERSION, &answer)) {
+        exit(1);
+    }
+    printf("Board protocol %u, firmware %u.%u\n", answer.info.ls_version.lv_protocol,
+           answer.info.ls_version.lv_major, answer.info.ls_version.lv_minor);
+
+    // Every strip, a different color each time so nothing can be skipped.
+    benchDevice = fd;
+    benchWrites = 0;
+    benchBytes = 0;
+    start = seconds();
+    for (int i = 0; i < count; i++) {
+        animate_message(&msg, StripMaskT<MAXVSTRIPS>::first(MAXVSTRIPS), 1, 500, 0, (uint32_t) i);
+        if (split) {
+            send_split(fd, &msg);
+        } else {
+            send_command(fd, &msg);
+        }
+    }
+    benchDevice = -1;
+    if (!ask(fd, rx, LSCMD_STATUS, &answer)) {
+        exit(1);
+    }
+    elapsed = seconds() - start;
+    close(fd);
+
+    printf("%d messages in %.1f ms%s\n", count, elapsed * 1000.0, split ? ", sync bytes written separately" : "");
+    printf("    %.0f messages/s\n", count / elapsed);
+    printf("    %.2f write() calls per message\n", (double) benchWrites / count);
+    printf("    %.1f bytes per message\n", (double) benchBytes / count);
+
+    return 0;
+}
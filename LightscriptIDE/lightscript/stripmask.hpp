@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// A set of virtual strips, one bit per strip.  The words are laid out the
+// same way as la_strips in the animate message, so they can be copied
+// straight onto the wire.
+//
+// Every operation is a fixed-length loop over the words with no branches,
+// which the compiler turns into vector instructions (SSE2 or NEON) on its own.
+//
+template <int BITS>
+class StripMaskT {
+public:
+    static const int WORDS = (BITS + 31) / 32;
+
+    uint32_t w[WORDS];
+
+    StripMaskT() : w{} {}
+
+    // Just strip 'v'
+    static StripMaskT bit(int v) {
+        StripMaskT m;
+        m.set(v);
+        return m;
+    }
+
+    // Strips 0 through n-1
+    static StripMaskT first(int n) {
+        StripMaskT m;
+        for (int i = 0; i < WORDS; i++) {
+            int b = n - i*32;
+            m.w[i] = (b >= 32) ? 0xFFFFFFFF : ((b > 0) ? ((1U << b) - 1) : 0);
+        }
+        return m;
+    }
+
+    void clear(void) {
+        for (int i = 0; i < WORDS; i++) w[i] = 0;
+    }
+
+    void set(int v) {
+        w[v/32] |= 1U << (v & 31);
+    }
+
+    bool test(int v) const {
+        return (w[v/32] >> (v & 31)) & 1;
+    }
+
+    bool any(void) const {
+        uint32_t x = 0;
+        for (int i = 0; i < WORDS; i++) x |= w[i];
+        return x != 0;
+    }
+
+    bool none(void) const {
+        return !any();
+    }
+
+    int count(void) const {
+        int n = 0;
+        for (int i = 0; i < WORDS; i++) n += __builtin_popcount(w[i]);
+        return n;
+    }
+
+    bool intersects(const StripMaskT& o) const {
+        uint32_t x = 0;
+        for (int i = 0; i < WORDS; i++) x |= w[i] & o.w[i];
+        return x != 0;
+    }
+
+    // Strips in this set but not in 'o'
+    StripMaskT andNot(const StripMaskT& o) const {
+        StripMaskT m;
+        for (int i = 0; i < WORDS; i++) m.w[i] = w[i] & ~o.w[i];
+        return m;
+    }
+
+    // Lowest numbered strip, or -1 if there are none
+    int lowest(void) const {
+        for (int i = 0; i < WORDS; i++) {
+            if (w[i]) return i*32 + __builtin_ctz(w[i]);
+        }
+        return -1;
+    }
+
+    // The N strips starting at 'first', which must be a multiple of 32
+    template <int N>
+    StripMaskT<N> slice(int first) const {
+        StripMaskT<N> m;
+        for (int i = 0; i < StripMaskT<N>::WORDS; i++) m.w[i] = w[first/32 + i];
+        return m;
+    }
+
+    // Call f(v) for each strip in the set, lowest first
+    template <typename F>
+    void forEach(F f) const {
+        for (int i = 0; i < WORDS; i++) {
+            for (uint32_t bits = w[i]; bits; bits &= bits - 1) {
+                f(i*32 + __builtin_ctz(bits));
+            }
+        }
+    }
+
+    StripMaskT& operator|=(const StripMaskT& o) {
+        for (int i = 0; i < WORDS; i++) w[i] |= o.w[i];
+        return *this;
+    }
+
+    StripMaskT& operator&=(const StripMaskT& o) {
+        for (int i = 0; i < WORDS; i++) w[i] &= o.w[i];
+        return *this;
+    }
+
+    StripMaskT operator|(const StripMaskT& o) const {
+        StripMaskT m = *this;
+        return m |= o;
+    }
+
+    StripMaskT operator&(const StripMaskT& o) const {
+        StripMaskT m = *this;
+        return m &= o;
+    }
+
+    bool operator==(const StripMaskT& o) const {
+        uint32_t x = 0;
+        for (int i = 0; i < WORDS; i++) x |= w[i] ^ o.w[i];
+        return x == 0;
+    }
+
+    bool operator!=(const StripMaskT& o) const {
+        return !(*this == o);
+    }
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "picoprotocol.h"
+#include "stripmask.hpp"
+
+//
+// Messages as they go down the wire to the board: two sync bytes, then the
+// message header and payload.
+//
+#define LSFRAME_SYNCSIZE        2
+#define LSFRAME_MAX             (LSFRAME_SYNCSIZE + sizeof(lsmessage_t))
+#define LSFRAME_ANIMATE_BYTES   (LSFRAME_SYNCSIZE + LSMSG_HDRSIZE + sizeof(lsanimate_t))
+#define LSFRAME_ANIMATE_AT_BYTES (LSFRAME_SYNCSIZE + LSMSG_HDRSIZE + sizeof(lsanimateat_t))
+
+static_assert(sizeof(StripMaskT<MAXVSTRIPS>) == sizeof(((lsanimate_t *) 0)->la_strips), "strip mask must match the wire format");
+
+// Put the sync bytes and the message into 'frame', return the length.
+static inline int frame_message(uint8_t *frame, const lsmessage_t *msg)
+{
+    int txlen = LSMSG_HDRSIZE + msg->ls_length;
+
+    frame[0] = 0x02;
+    frame[1] = 0xAA;
+    memcpy(&frame[LSFRAME_SYNCSIZE], msg, txlen);
+
+    return txlen + LSFRAME_SYNCSIZE;
+}
+
+// Write one or more frames, all of them.
+static inline int write_frames(int device, const uint8_t *buf, size_t len)
+{
+    ssize_t res;
+
+    if (device <= 0) {
+        return -1;
+    }
+
+    while (len > 0) {
+        res = write(device, buf, len);
+        if (res <= 0) {
+            perror("Write Error to Picolight [cmd]");
+            exit(1);
+        }
+        buf += res;
+        len -= res;
+    }
+
+    return 0;
+}
+
+// Send the sync bytes and the message in one write, so each message is
+// one system call and (with TCP_NODELAY) one packet.
+static inline int send_command(int device, lsmessage_t *msg)
+{
+    uint8_t frame[LSFRAME_MAX];
+
+    return write_frames(device, frame, frame_message(frame, msg));
+}
+
+static inline void animate_message(lsmessage_t *msg, const StripMaskT<MAXVSTRIPS>& strips, uint16_t anim,  uint16_t speed, uint16_t option, uint32_t color)
+{
+    memset(msg,0,sizeof(*msg));
+
+    memcpy(msg->info.ls_animate.la_strips, strips.w, sizeof(strips.w));
+
+    msg->info.ls_animate.la_anim = anim;
+    msg->info.ls_animate.la_speed = speed;
+    msg->info.ls_animate.la_option = option;
+    msg->info.ls_animate.la_color = color;
+    msg->ls_length = sizeof(lsanimate_t);
+    msg->ls_command = LSCMD_ANIMATE;
+}
+
+// Turn an animate frame into one that runs at board time 'when'.
+static inline int frame_animate_at(uint8_t *frame, const uint8_t *animate, uint32_t when)
+{
+    frame[0] = 0x02;
+    frame[1] = 0xAA;
+    frame[LSFRAME_SYNCSIZE] = LSCMD_ANIMATE_AT;
+    frame[LSFRAME_SYNCSIZE + 1] = sizeof(lsanimateat_t);
+    memcpy(&frame[LSFRAME_SYNCSIZE + LSMSG_HDRSIZE], &when, sizeof(when));
+    memcpy(&frame[LSFRAME_SYNCSIZE + LSMSG_HDRSIZE + sizeof(when)],
+           &animate[LSFRAME_SYNCSIZE + LSMSG_HDRSIZE], sizeof(lsanimate_t));
+
+    return LSFRAME_ANIMATE_AT_BYTES;
+}